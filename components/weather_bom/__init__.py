@@ -1,13 +1,56 @@
+from esphome import automation
 import esphome.codegen as cg
 import esphome.config_validation as cv
-from esphome.components import sensor, text_sensor
-from esphome.const import CONF_ID
+import esphome.final_validate as fv
+from esphome.components import (
+    binary_sensor,
+    deep_sleep,
+    esp32,
+    sensor,
+    text_sensor,
+)
+from esphome.const import (
+    CONF_ID,
+    CONF_TRIGGER_ID,
+    DEVICE_CLASS_DURATION,
+    DEVICE_CLASS_PROBLEM,
+    ENTITY_CATEGORY_DIAGNOSTIC,
+    STATE_CLASS_MEASUREMENT,
+    STATE_CLASS_TOTAL_INCREASING,
+)
+from esphome.core import CORE, TimePeriod
 
-AUTO_LOAD = ["sensor", "text_sensor"]
+AUTO_LOAD = ["binary_sensor", "network", "sensor", "text_sensor"]
 CODEOWNERS = ["@andrew-b"]
+# One block per location; all blocks share a single FetchEngine
+MULTI_CONF = True
+DOMAIN = "weather_bom"
 
 ns = cg.esphome_ns.namespace("weather_bom")
 WeatherBOM = ns.class_("WeatherBOM", cg.PollingComponent)
+FetchEngine = ns.class_("FetchEngine", cg.Component)
+SnapshotServer = ns.class_("SnapshotServer", cg.Component)
+Endpoint = ns.enum("Endpoint")
+Telemetry = ns.enum("Telemetry")
+DaySensor = ns.enum("DaySensor")
+DayText = ns.enum("DayText")
+HourlyField = ns.enum("HourlyField")
+HistoryStat = ns.enum("HistoryStat")
+WarningData = ns.struct("WarningData")
+NewWarningTrigger = ns.class_(
+    "NewWarningTrigger",
+    automation.Trigger.template(WarningData.operator("ref").operator("const")),
+)
+
+# Endpoints, keyed by the prefix of their per-endpoint options
+ENDPOINTS = {
+    "observations": Endpoint.ENDPOINT_OBSERVATIONS,
+    "forecast": Endpoint.ENDPOINT_FORECAST,
+    "warnings": Endpoint.ENDPOINT_WARNINGS,
+    "hourly": Endpoint.ENDPOINT_HOURLY,
+}
+# Bit of each in an endpoint mask (enum Endpoint order)
+ENDPOINT_BITS = {ep: i for i, ep in enumerate(ENDPOINTS)}
 
 ICON_ALERT = "mdi:alert"
 ICON_THERMOMETER = "mdi:thermometer"
@@ -16,6 +59,16 @@ ICON_RAIN_AMOUNT = "mdi:weather-rainy"
 ICON_WINDY = "mdi:weather-windy"
 ICON_HUMIDITY = "mdi:water-percent"
 ICON_CLOCK = "mdi:clock-outline"
+ICON_HANDSHAKE = "mdi:handshake"
+ICON_CACHED = "mdi:cached"
+ICON_DOWNLOAD = "mdi:download"
+ICON_FILTER = "mdi:filter-outline"
+ICON_MEMORY = "mdi:memory"
+ICON_TIMER = "mdi:timer-outline"
+ICON_CHECK = "mdi:check-circle-outline"
+ICON_RETRY = "mdi:restart"
+ICON_BREAKER = "mdi:electric-switch"
+ICON_TREND = "mdi:chart-line-variant"
 
 # Inputs
 CONF_GEOHASH = "geohash"
@@ -23,41 +76,327 @@ CONF_LATITUDE = "latitude"
 CONF_LONGITUDE = "longitude"
 CONF_LAT_SENSOR = "latitude_sensor"
 CONF_LON_SENSOR = "longitude_sensor"
+# GPS: look the location up again once the position is movement_threshold
+# from where it was last resolved and in another geohash cell; fixes within
+# movement_debounce of the first are taken together
+CONF_MOVEMENT_THRESHOLD = "movement_threshold"
+CONF_MOVEMENT_DEBOUNCE = "movement_debounce"
+
+# Transport
+CONF_API_BASE_URL = "api_base_url"
+# LAN aggregation: serve_snapshot blocks publish their data at
+# /weather_bom/<id> on the web server; a block with snapshot_url takes all of
+# its data from there instead of from BOM
+CONF_SERVE_SNAPSHOT = "serve_snapshot"
+CONF_SNAPSHOT_SERVER_ID = "snapshot_server_id"
+CONF_SNAPSHOT_URL = "snapshot_url"
+CONF_COUNT_ALLOCATIONS = "count_allocations"
+
+# Persistence
+CONF_WARM_START = "warm_start"
+# Battery mode: data, validators and schedule are kept in RTC memory through
+# deep sleep; each wake fetches only what is due, then the block puts the
+# device back to sleep until the next endpoint is due
+CONF_DEEP_SLEEP_ID = "deep_sleep_id"
+
+# Fetch worker task (ESP-IDF), shared by all blocks: set it on any one of
+# them, or identically on several
+CONF_ENGINE_ID = "engine_id"
+CONF_TASK_STACK_SIZE = "task_stack_size"
+CONF_TASK_PRIORITY = "task_priority"
+CONF_TASK_CORE = "task_core"
+# Concurrent fetching: connections per cycle, within a heap budget
+CONF_MAX_CONCURRENT_FETCHES = "max_concurrent_fetches"
+CONF_FETCH_HEAP_BUDGET = "fetch_heap_budget"
+# Parser state from a block taken at boot (PSRAM if present); 0 = heap
+CONF_PARSE_ARENA_SIZE = "parse_arena_size"
+# Accept-Encoding: gzip, inflated on the fly (32 KB window per connection)
+CONF_GZIP = "gzip"
+ENGINE_OPTIONS = (
+    CONF_TASK_STACK_SIZE,
+    CONF_TASK_PRIORITY,
+    CONF_TASK_CORE,
+    CONF_MAX_CONCURRENT_FETCHES,
+    CONF_FETCH_HEAP_BUDGET,
+    CONF_PARSE_ARENA_SIZE,
+    CONF_GZIP,
+)
 
 # Observations
 CONF_TEMPERATURE = "temperature"
 CONF_HUMIDITY = "humidity"
 CONF_WIND_KMH = "wind_speed_kmh"
 CONF_RAIN_SINCE_9AM = "rain_since_9am"
+OBSERVATION_KEYS = (
+    CONF_TEMPERATURE,
+    CONF_HUMIDITY,
+    CONF_WIND_KMH,
+    CONF_RAIN_SINCE_9AM,
+)
 
-# Forecast Today
-CONF_TODAY_MIN = "today_min"
-CONF_TODAY_MAX = "today_max"
-CONF_TODAY_RAIN_CHANCE = "today_rain_chance"
-CONF_TODAY_SUMMARY = "today_summary"
-CONF_TODAY_ICON = "today_icon"
-CONF_TODAY_RAIN_MIN = "today_rain_min"
-CONF_TODAY_RAIN_MAX = "today_rain_max"
-CONF_TODAY_SUNRISE = "today_sunrise"
-CONF_TODAY_SUNSET = "today_sunset"
-
-
-# Forecast Tomorrow
-CONF_TOMORROW_MIN = "tomorrow_min"
-CONF_TOMORROW_MAX = "tomorrow_max"
-CONF_TOMORROW_RAIN_CHANCE = "tomorrow_rain_chance"
-CONF_TOMORROW_SUMMARY = "tomorrow_summary"
-CONF_TOMORROW_ICON = "tomorrow_icon"
-CONF_TOMORROW_RAIN_MIN = "tomorrow_rain_min"
-CONF_TOMORROW_RAIN_MAX = "tomorrow_rain_max"
-CONF_TOMORROW_SUNRISE = "tomorrow_sunrise"
-CONF_TOMORROW_SUNSET = "tomorrow_sunset"
+# Observation history: one slot per history_interval (144 of them, 24 h at
+# the default), kept in RAM from boot on; any HISTORY_SENSORS key or
+# history_interval turns it on
+CONF_HISTORY_INTERVAL = "history_interval"
+DEFAULT_HISTORY_INTERVAL = TimePeriod(minutes=10)
 
-# Meta
+# Forecast, per day: forecast_days entries pick a day (0 = today) and take the
+# DAY_SENSORS/DAY_TEXT_SENSORS keys; today_<key> and tomorrow_<key> are
+# shorthands for days 0 and 1
+CONF_FORECAST_DAYS = "forecast_days"
+CONF_DAY = "day"
+FORECAST_DAYS = 7  # FORECAST_DAYS in weather_bom.h
+DAY_ALIASES = {"today": 0, "tomorrow": 1}
+
+# Hourly forecast: the next hourly_hours hours are kept from each fetch, and
+# forecast_hours entries publish HOURLY_SENSORS for a given number of hours
+# ahead (0 = the current hour).
+CONF_HOURLY_HOURS = "hourly_hours"
+CONF_FORECAST_HOURS = "forecast_hours"
+CONF_HOURS = "hours"
+HOURLY_CAPACITY = 48  # HourlyRing::CAPACITY in hourly_ring.h
+
+# Warnings: the count and highest warning_group_type (0 none, 1 minor,
+# 2 major) leave cancelled warnings out; on_new_warning runs with `warning`
+# for each one whose content differs from all previously published ones
 CONF_WARNINGS_JSON = "warnings_json"
+CONF_WARNINGS_COUNT = "warnings_count"
+CONF_WARNINGS_MAX_SEVERITY = "warnings_max_severity"
+CONF_ON_NEW_WARNING = "on_new_warning"
+WARNING_KEYS = (
+    CONF_WARNINGS_JSON,
+    CONF_WARNINGS_COUNT,
+    CONF_WARNINGS_MAX_SEVERITY,
+    CONF_ON_NEW_WARNING,
+)
+
+# Meta
 CONF_LOCATION_NAME = "location_name"
 CONF_OUT_GEOHASH = "out_geohash"
 CONF_LAST_UPDATE = "last_update"
+CONF_DATA_STALE = "data_stale"
+
+# Scheduling, per endpoint (e.g. warnings_interval); unset follows
+# update_interval. The forecast is polled just after each advertised issue, at
+# most forecast_interval apart.
+CONF_INTERVAL = "interval"
+# Failed endpoints retry after retry_initial, doubling up to retry_max with
+# jitter; breaker_threshold failures in a row open the endpoint's circuit
+CONF_RETRY_INITIAL = "retry_initial"
+CONF_RETRY_MAX = "retry_max"
+CONF_BREAKER_THRESHOLD = "breaker_threshold"
+DEFAULT_FORECAST_INTERVAL = "1h"
+DEFAULT_HOURLY_INTERVAL = "1h"
+
+# Diagnostics
+CONF_TLS_HANDSHAKES_AVOIDED = "tls_handshakes_avoided"
+CONF_PUBLISHES_SUPPRESSED = "publishes_suppressed"
+CONF_TASK_STACK_FREE = "task_stack_free"
+CONF_HEAP_MIN_FREE = "heap_min_free"
+CONF_HEAP_LARGEST_BLOCK = "heap_largest_block"
+CONF_HEAP_BLOCK_BEFORE = "heap_largest_block_before"
+CONF_HEAP_BLOCK_AFTER = "heap_largest_block_after"
+CONF_PARSE_ARENA_USED = "parse_arena_used"
+CONF_PARSE_ARENA_FALLBACKS = "parse_arena_fallbacks"
+CONF_AWAKE_TIME = "awake_time"
+CONF_TIME_TO_FIRST_DATA = "time_to_first_data"
+# Per endpoint, prefixed with the ENDPOINTS key, e.g. forecast_cache_hits
+CONF_CACHE_HITS = "cache_hits"
+CONF_CACHE_MISSES = "cache_misses"
+CONF_CIRCUIT = "circuit"
+
+
+def _counter_schema(icon):
+    return sensor.sensor_schema(
+        icon=icon,
+        accuracy_decimals=0,
+        state_class=STATE_CLASS_TOTAL_INCREASING,
+        entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+    )
+
+
+def _gauge_schema(unit, icon, device_class=None):
+    return sensor.sensor_schema(
+        unit_of_measurement=unit,
+        icon=icon,
+        accuracy_decimals=0,
+        device_class=device_class,
+        state_class=STATE_CLASS_MEASUREMENT,
+        entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+    )
+
+
+def _ms_schema():
+    return _gauge_schema("ms", ICON_TIMER, DEVICE_CLASS_DURATION)
+
+
+ENDPOINT_SENSORS = {
+    CONF_CACHE_HITS: ("set_cache_hits_sensor", _counter_schema(ICON_CACHED)),
+    CONF_CACHE_MISSES: ("set_cache_misses_sensor", _counter_schema(ICON_DOWNLOAD)),
+}
+
+ENDPOINT_TEXT_SENSORS = {
+    CONF_CIRCUIT: (
+        "set_circuit_text_sensor",
+        text_sensor.text_sensor_schema(
+            icon=ICON_BREAKER, entity_category=ENTITY_CATEGORY_DIAGNOSTIC
+        ),
+    ),
+}
+
+DAY_SENSORS = {
+    "min": (
+        DaySensor.DAY_TEMP_MIN,
+        sensor.sensor_schema(
+            unit_of_measurement="°C", icon=ICON_THERMOMETER, accuracy_decimals=1
+        ),
+    ),
+    "max": (
+        DaySensor.DAY_TEMP_MAX,
+        sensor.sensor_schema(
+            unit_of_measurement="°C", icon=ICON_THERMOMETER, accuracy_decimals=1
+        ),
+    ),
+    "rain_chance": (
+        DaySensor.DAY_RAIN_CHANCE,
+        sensor.sensor_schema(
+            unit_of_measurement="%", icon=ICON_RAIN_CHANCE, accuracy_decimals=0
+        ),
+    ),
+    "rain_min": (DaySensor.DAY_RAIN_MIN, sensor.sensor_schema(icon=ICON_RAIN_AMOUNT)),
+    "rain_max": (DaySensor.DAY_RAIN_MAX, sensor.sensor_schema(icon=ICON_RAIN_AMOUNT)),
+}
+
+DAY_TEXT_SENSORS = {
+    "summary": (DayText.DAY_SUMMARY, text_sensor.text_sensor_schema()),
+    "icon": (DayText.DAY_ICON, text_sensor.text_sensor_schema()),
+    "sunrise": (DayText.DAY_SUNRISE, text_sensor.text_sensor_schema(icon=ICON_CLOCK)),
+    "sunset": (DayText.DAY_SUNSET, text_sensor.text_sensor_schema(icon=ICON_CLOCK)),
+}
+
+FORECAST_DAY_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_DAY): cv.int_range(min=0, max=FORECAST_DAYS - 1),
+        **{
+            cv.Optional(key): schema
+            for key, (_, schema) in (
+                *DAY_SENSORS.items(),
+                *DAY_TEXT_SENSORS.items(),
+            )
+        },
+    }
+)
+
+HOURLY_SENSORS = {
+    CONF_TEMPERATURE: (
+        HourlyField.HOURLY_TEMPERATURE,
+        sensor.sensor_schema(
+            unit_of_measurement="°C", icon=ICON_THERMOMETER, accuracy_decimals=1
+        ),
+    ),
+    "rain_chance": (
+        HourlyField.HOURLY_RAIN_CHANCE,
+        sensor.sensor_schema(
+            unit_of_measurement="%", icon=ICON_RAIN_CHANCE, accuracy_decimals=0
+        ),
+    ),
+    CONF_WIND_KMH: (
+        HourlyField.HOURLY_WIND_KMH,
+        sensor.sensor_schema(
+            unit_of_measurement="km/h", icon=ICON_WINDY, accuracy_decimals=0
+        ),
+    ),
+}
+
+FORECAST_HOUR_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_HOURS): cv.int_range(min=0, max=HOURLY_CAPACITY - 1),
+        **{
+            cv.Optional(key): schema
+            for key, (_, schema) in HOURLY_SENSORS.items()
+        },
+    }
+)
+
+HISTORY_SENSORS = {
+    "history_temperature_min": (
+        HistoryStat.HISTORY_TEMP_MIN,
+        sensor.sensor_schema(
+            unit_of_measurement="°C", icon=ICON_THERMOMETER, accuracy_decimals=1
+        ),
+    ),
+    "history_temperature_max": (
+        HistoryStat.HISTORY_TEMP_MAX,
+        sensor.sensor_schema(
+            unit_of_measurement="°C", icon=ICON_THERMOMETER, accuracy_decimals=1
+        ),
+    ),
+    "history_temperature_mean": (
+        HistoryStat.HISTORY_TEMP_MEAN,
+        sensor.sensor_schema(
+            unit_of_measurement="°C",
+            icon=ICON_THERMOMETER,
+            accuracy_decimals=1,
+            state_class=STATE_CLASS_MEASUREMENT,
+        ),
+    ),
+    "temperature_trend": (
+        HistoryStat.HISTORY_TEMP_TREND,
+        sensor.sensor_schema(
+            unit_of_measurement="°C/3h",
+            icon=ICON_TREND,
+            accuracy_decimals=1,
+            state_class=STATE_CLASS_MEASUREMENT,
+        ),
+    ),
+    "rain_rate": (
+        HistoryStat.HISTORY_RAIN_RATE,
+        sensor.sensor_schema(
+            unit_of_measurement="mm/h",
+            icon=ICON_RAIN_AMOUNT,
+            accuracy_decimals=1,
+            state_class=STATE_CLASS_MEASUREMENT,
+        ),
+    ),
+}
+
+# Per-request telemetry, also prefixed with the ENDPOINTS key, e.g.
+# forecast_ttfb. Times are of the endpoint's last request that got a response.
+ENDPOINT_TELEMETRY = {
+    "connect_time": (Telemetry.TELEMETRY_CONNECT_TIME, _ms_schema()),
+    "ttfb": (Telemetry.TELEMETRY_TTFB, _ms_schema()),
+    "download_time": (Telemetry.TELEMETRY_DOWNLOAD_TIME, _ms_schema()),
+    "bytes_received": (
+        Telemetry.TELEMETRY_BYTES,
+        _gauge_schema("B", ICON_DOWNLOAD),
+    ),
+    "bytes_decoded": (
+        Telemetry.TELEMETRY_BYTES_DECODED,
+        _gauge_schema("B", ICON_DOWNLOAD),
+    ),
+    "parse_time": (Telemetry.TELEMETRY_PARSE_TIME, _ms_schema()),
+    "fetch_successes": (
+        Telemetry.TELEMETRY_SUCCESSES,
+        _counter_schema(ICON_CHECK),
+    ),
+    "fetch_failures": (
+        Telemetry.TELEMETRY_FAILURES,
+        _counter_schema(ICON_ALERT),
+    ),
+    "consecutive_failures": (
+        Telemetry.TELEMETRY_CONSECUTIVE_FAILURES,
+        _gauge_schema(None, ICON_ALERT),
+    ),
+    "retries": (Telemetry.TELEMETRY_RETRIES, _counter_schema(ICON_RETRY)),
+    "retry_delay": (
+        Telemetry.TELEMETRY_RETRY_DELAY,
+        _gauge_schema("s", ICON_TIMER, DEVICE_CLASS_DURATION),
+    ),
+    "breaker_trips": (
+        Telemetry.TELEMETRY_BREAKER_TRIPS,
+        _counter_schema(ICON_BREAKER),
+    ),
+}
 
 
 def _validate_location(cfg):
@@ -72,6 +411,14 @@ def _validate_location(cfg):
     ]
     provided_count = sum(loc_methods)
 
+    if CONF_SNAPSHOT_URL in cfg:
+        # The server's block decides the location
+        if provided_count > 0:
+            raise cv.Invalid(
+                f"{CONF_SNAPSHOT_URL} takes the location of the serving block; "
+                "remove geohash, latitude/longitude and their sensors"
+            )
+        return cfg
     if provided_count == 0:
         raise cv.Invalid(
             "Provide exactly one location method: geohash OR latitude+longitude OR latitude_sensor+longitude_sensor"
@@ -81,6 +428,13 @@ def _validate_location(cfg):
             "Provide exactly one location method: geohash OR latitude+longitude OR latitude_sensor+longitude_sensor"
         )
 
+    if not (lats and lons):
+        for key in (CONF_MOVEMENT_THRESHOLD, CONF_MOVEMENT_DEBOUNCE):
+            if key in cfg:
+                raise cv.Invalid(
+                    f"{key} only applies to {CONF_LAT_SENSOR}/{CONF_LON_SENSOR}"
+                )
+
     if lat is not None:
         if not -90 <= lat <= 90:
             raise cv.Invalid(f"Latitude must be between -90 and 90, got {lat}")
@@ -91,15 +445,149 @@ def _validate_location(cfg):
     return cfg
 
 
+def _forecast_day_entities(cfg):
+    """Yields (day, key, entity config) for every configured forecast entity."""
+    for prefix, day in DAY_ALIASES.items():
+        for key in (*DAY_SENSORS, *DAY_TEXT_SENSORS):
+            if (conf := cfg.get(f"{prefix}_{key}")) is not None:
+                yield day, key, conf
+    for entry in cfg.get(CONF_FORECAST_DAYS, []):
+        for key in (*DAY_SENSORS, *DAY_TEXT_SENSORS):
+            if (conf := entry.get(key)) is not None:
+                yield entry[CONF_DAY], key, conf
+
+
+def _endpoints_used(cfg):
+    """ENDPOINTS keys some entity or trigger of the block takes data from.
+
+    The others are never requested, and their code is only built in if
+    another block needs it. Per-endpoint diagnostics alone do not count.
+    """
+    used = []
+    if any(
+        key in cfg
+        for key in (*OBSERVATION_KEYS, *HISTORY_SENSORS, CONF_HISTORY_INTERVAL)
+    ):
+        used.append("observations")
+    if next(_forecast_day_entities(cfg), None) is not None:
+        used.append("forecast")
+    if any(key in cfg for key in WARNING_KEYS):
+        used.append("warnings")
+    if any(
+        key in entry for entry in cfg.get(CONF_FORECAST_HOURS, [])
+        for key in HOURLY_SENSORS
+    ):
+        used.append("hourly")
+    return used
+
+
+def _validate_forecast_days(cfg):
+    seen = set()
+    for day, key, _ in _forecast_day_entities(cfg):
+        if (day, key) in seen:
+            raise cv.Invalid(f"Forecast day {day} {key} is configured more than once")
+        seen.add((day, key))
+    return cfg
+
+
+def _validate_forecast_hours(cfg):
+    for entry in cfg.get(CONF_FORECAST_HOURS, []):
+        if entry[CONF_HOURS] >= cfg[CONF_HOURLY_HOURS]:
+            raise cv.Invalid(
+                f"forecast_hours entry for {entry[CONF_HOURS]} hours ahead is "
+                f"beyond {CONF_HOURLY_HOURS} ({cfg[CONF_HOURLY_HOURS]})"
+            )
+    return cfg
+
+
+def _validate_endpoints(cfg):
+    # With location entities only, the location search runs on its own
+    if not _endpoints_used(cfg) and not any(
+        key in cfg for key in (CONF_LOCATION_NAME, CONF_OUT_GEOHASH)
+    ):
+        raise cv.Invalid(
+            "No observation, forecast, hourly, warning or location entity is "
+            "configured, so nothing would ever be fetched"
+        )
+    return cfg
+
+
+def _validate_retry(cfg):
+    if cfg[CONF_RETRY_MAX] < cfg[CONF_RETRY_INITIAL]:
+        raise cv.Invalid(f"{CONF_RETRY_MAX} must not be below {CONF_RETRY_INITIAL}")
+    return cfg
+
+
+def _validate_transport(cfg):
+    # A snapshot client never calls BOM itself
+    url = cfg.get(CONF_SNAPSHOT_URL, cfg[CONF_API_BASE_URL])
+    if CORE.is_host and not url.startswith("http://"):
+        raise cv.Invalid(
+            "The host build only speaks plain HTTP; point api_base_url at a "
+            "local stand-in server (see tools/bom_stub_server.py)"
+        )
+    if cfg[CONF_COUNT_ALLOCATIONS] and not CORE.is_host:
+        raise cv.Invalid("count_allocations is only available on the host platform")
+    if cfg[CONF_SERVE_SNAPSHOT]:
+        if not CORE.using_esp_idf:
+            raise cv.Invalid(f"{CONF_SERVE_SNAPSHOT} needs the ESP-IDF framework")
+        if "web_server_base" not in CORE.loaded_integrations:
+            raise cv.Invalid(
+                f"{CONF_SERVE_SNAPSHOT} answers on the web server; add "
+                "web_server: (or web_server_base:) to the configuration"
+            )
+    return cfg
+
+
+def _validate_battery(cfg):
+    if CONF_DEEP_SLEEP_ID not in cfg:
+        if CONF_AWAKE_TIME in cfg:
+            raise cv.Invalid(f"{CONF_AWAKE_TIME} needs {CONF_DEEP_SLEEP_ID}")
+        return cfg
+    if not CORE.using_esp_idf:
+        raise cv.Invalid(f"{CONF_DEEP_SLEEP_ID} needs the ESP-IDF framework")
+    if cfg[CONF_SERVE_SNAPSHOT]:
+        raise cv.Invalid(
+            f"A block that sleeps cannot serve snapshots; remove "
+            f"{CONF_SERVE_SNAPSHOT} or {CONF_DEEP_SLEEP_ID}"
+        )
+    return cfg
+
+
 CONFIG_SCHEMA = cv.All(
     cv.Schema(
         {
             cv.GenerateID(): cv.declare_id(WeatherBOM),
+            cv.GenerateID(CONF_ENGINE_ID): cv.declare_id(FetchEngine),
             cv.Optional(CONF_GEOHASH): cv.string,
             cv.Optional(CONF_LATITUDE): cv.float_,
             cv.Optional(CONF_LONGITUDE): cv.float_,
             cv.Optional(CONF_LAT_SENSOR): cv.use_id(sensor.Sensor),
             cv.Optional(CONF_LON_SENSOR): cv.use_id(sensor.Sensor),
+            cv.Optional(CONF_MOVEMENT_THRESHOLD): cv.All(
+                cv.distance, cv.Range(min=0, max=100000)
+            ),
+            cv.Optional(
+                CONF_MOVEMENT_DEBOUNCE
+            ): cv.positive_time_period_milliseconds,
+            cv.Optional(
+                CONF_API_BASE_URL, default="https://api.weather.bom.gov.au/v1"
+            ): cv.All(cv.url, lambda v: v.rstrip("/")),
+            cv.Optional(CONF_COUNT_ALLOCATIONS, default=False): cv.boolean,
+            cv.Optional(CONF_SERVE_SNAPSHOT, default=False): cv.boolean,
+            cv.GenerateID(CONF_SNAPSHOT_SERVER_ID): cv.declare_id(SnapshotServer),
+            cv.Optional(CONF_SNAPSHOT_URL): cv.url,
+            cv.Optional(CONF_WARM_START, default=True): cv.boolean,
+            cv.Optional(CONF_DEEP_SLEEP_ID): cv.use_id(
+                deep_sleep.DeepSleepComponent
+            ),
+            cv.Optional(CONF_TASK_STACK_SIZE): cv.int_range(min=3072, max=32768),
+            cv.Optional(CONF_TASK_PRIORITY): cv.int_range(min=1, max=24),
+            cv.Optional(CONF_TASK_CORE): cv.int_range(min=0, max=1),
+            cv.Optional(CONF_MAX_CONCURRENT_FETCHES): cv.int_range(min=1, max=4),
+            cv.Optional(CONF_FETCH_HEAP_BUDGET): cv.int_range(min=16384),
+            cv.Optional(CONF_PARSE_ARENA_SIZE): cv.int_range(min=0, max=65536),
+            cv.Optional(CONF_GZIP): cv.boolean,
 
             # Observations
             cv.Optional(CONF_TEMPERATURE): sensor.sensor_schema(
@@ -123,84 +611,205 @@ CONFIG_SCHEMA = cv.All(
                 accuracy_decimals=1,
             ),
 
-            # Today
-            cv.Optional(CONF_TODAY_MIN): sensor.sensor_schema(
-                unit_of_measurement="°C",
-                icon=ICON_THERMOMETER,
-                accuracy_decimals=1
+            cv.Optional(CONF_HISTORY_INTERVAL): cv.All(
+                cv.positive_time_period_milliseconds,
+                cv.Range(min=TimePeriod(minutes=1), max=TimePeriod(hours=1)),
             ),
-            cv.Optional(CONF_TODAY_MAX): sensor.sensor_schema(
-                unit_of_measurement="°C",
-                icon=ICON_THERMOMETER,
-                accuracy_decimals=1
+            **{
+                cv.Optional(key): schema
+                for key, (_, schema) in HISTORY_SENSORS.items()
+            },
+
+            # Forecast
+            cv.Optional(CONF_FORECAST_DAYS): cv.ensure_list(FORECAST_DAY_SCHEMA),
+            cv.Optional(CONF_HOURLY_HOURS, default=12): cv.int_range(
+                min=1, max=HOURLY_CAPACITY
             ),
-            cv.Optional(CONF_TODAY_RAIN_CHANCE): sensor.sensor_schema(
-                unit_of_measurement="%",
-                icon=ICON_RAIN_CHANCE,
-                accuracy_decimals=0
+            cv.Optional(CONF_FORECAST_HOURS): cv.ensure_list(FORECAST_HOUR_SCHEMA),
+            # Meta
+            cv.Optional(CONF_WARNINGS_JSON): text_sensor.text_sensor_schema(
+                icon=ICON_ALERT
             ),
-            cv.Optional(CONF_TODAY_RAIN_MIN): sensor.sensor_schema(
-                icon=ICON_RAIN_AMOUNT
+            cv.Optional(CONF_WARNINGS_COUNT): sensor.sensor_schema(
+                icon=ICON_ALERT,
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_MEASUREMENT,
             ),
-            cv.Optional(CONF_TODAY_RAIN_MAX): sensor.sensor_schema(
-                icon=ICON_RAIN_AMOUNT
+            cv.Optional(CONF_WARNINGS_MAX_SEVERITY): sensor.sensor_schema(
+                icon=ICON_ALERT,
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_MEASUREMENT,
             ),
-            cv.Optional(CONF_TODAY_SUMMARY): text_sensor.text_sensor_schema(),
-            cv.Optional(CONF_TODAY_ICON): text_sensor.text_sensor_schema(),
-            cv.Optional(CONF_TODAY_SUNRISE): text_sensor.text_sensor_schema(
-                icon=ICON_CLOCK
+            cv.Optional(CONF_ON_NEW_WARNING): automation.validate_automation(
+                {
+                    cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(
+                        NewWarningTrigger
+                    ),
+                }
             ),
-            cv.Optional(CONF_TODAY_SUNSET): text_sensor.text_sensor_schema(
+            cv.Optional(CONF_LOCATION_NAME): text_sensor.text_sensor_schema(),
+            cv.Optional(CONF_OUT_GEOHASH): text_sensor.text_sensor_schema(),
+            cv.Optional(CONF_LAST_UPDATE): text_sensor.text_sensor_schema(
                 icon=ICON_CLOCK
             ),
-            # Tomorrow
-            cv.Optional(CONF_TOMORROW_MIN): sensor.sensor_schema(
-                unit_of_measurement="°C",
-                icon=ICON_THERMOMETER,
-                accuracy_decimals=1
-            ),
-            cv.Optional(CONF_TOMORROW_MAX): sensor.sensor_schema(
-                unit_of_measurement="°C",
-                icon=ICON_THERMOMETER,
-                accuracy_decimals=1
-            ),
-            cv.Optional(CONF_TOMORROW_RAIN_CHANCE): sensor.sensor_schema(
-                unit_of_measurement="%",
-                icon=ICON_RAIN_CHANCE,
-                accuracy_decimals=0
-            ),
-            cv.Optional(CONF_TOMORROW_RAIN_MIN): sensor.sensor_schema(
-                icon=ICON_RAIN_AMOUNT
+            cv.Optional(CONF_DATA_STALE): binary_sensor.binary_sensor_schema(
+                device_class=DEVICE_CLASS_PROBLEM,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
             ),
-            cv.Optional(CONF_TOMORROW_RAIN_MAX): sensor.sensor_schema(
-                icon=ICON_RAIN_AMOUNT
-            ),
-            cv.Optional(CONF_TOMORROW_SUMMARY): text_sensor.text_sensor_schema(),
-            cv.Optional(CONF_TOMORROW_ICON): text_sensor.text_sensor_schema(),
-            cv.Optional(CONF_TOMORROW_SUNRISE): text_sensor.text_sensor_schema(
-                icon=ICON_CLOCK
+            # Diagnostics
+            cv.Optional(CONF_TLS_HANDSHAKES_AVOIDED): _counter_schema(
+                ICON_HANDSHAKE
             ),
-            cv.Optional(CONF_TOMORROW_SUNSET): text_sensor.text_sensor_schema(
-                icon=ICON_CLOCK
+            cv.Optional(CONF_PUBLISHES_SUPPRESSED): _counter_schema(
+                ICON_FILTER
             ),
-            # Meta
-            cv.Optional(CONF_WARNINGS_JSON): text_sensor.text_sensor_schema(
-                icon=ICON_ALERT
-            ),
-            cv.Optional(CONF_LOCATION_NAME): text_sensor.text_sensor_schema(),
-            cv.Optional(CONF_OUT_GEOHASH): text_sensor.text_sensor_schema(),
-            cv.Optional(CONF_LAST_UPDATE): text_sensor.text_sensor_schema(
-                icon=ICON_CLOCK
+            cv.Optional(CONF_TASK_STACK_FREE): _gauge_schema("B", ICON_MEMORY),
+            cv.Optional(CONF_HEAP_MIN_FREE): _gauge_schema("B", ICON_MEMORY),
+            cv.Optional(CONF_HEAP_LARGEST_BLOCK): _gauge_schema("B", ICON_MEMORY),
+            cv.Optional(CONF_HEAP_BLOCK_BEFORE): _gauge_schema("B", ICON_MEMORY),
+            cv.Optional(CONF_HEAP_BLOCK_AFTER): _gauge_schema("B", ICON_MEMORY),
+            cv.Optional(CONF_PARSE_ARENA_USED): _gauge_schema("B", ICON_MEMORY),
+            cv.Optional(CONF_PARSE_ARENA_FALLBACKS): _counter_schema(ICON_MEMORY),
+            cv.Optional(CONF_AWAKE_TIME): _ms_schema(),
+            cv.Optional(CONF_TIME_TO_FIRST_DATA): _ms_schema(),
+        }
+    )
+    .extend(
+        {
+            cv.Optional(
+                f"forecast_{CONF_INTERVAL}", default=DEFAULT_FORECAST_INTERVAL
+            ): cv.update_interval,
+            cv.Optional(
+                f"hourly_{CONF_INTERVAL}", default=DEFAULT_HOURLY_INTERVAL
+            ): cv.update_interval,
+            cv.Optional(f"observations_{CONF_INTERVAL}"): cv.update_interval,
+            cv.Optional(f"warnings_{CONF_INTERVAL}"): cv.update_interval,
+            cv.Optional(
+                CONF_RETRY_INITIAL, default="30s"
+            ): cv.positive_time_period_milliseconds,
+            cv.Optional(
+                CONF_RETRY_MAX, default="30min"
+            ): cv.positive_time_period_milliseconds,
+            cv.Optional(CONF_BREAKER_THRESHOLD, default=5): cv.int_range(
+                min=1, max=255
             ),
         }
-    ).extend(cv.polling_component_schema("300s")),
+    )
+    .extend(
+        {
+            cv.Optional(f"{prefix}_{key}"): schema
+            for prefix in DAY_ALIASES
+            for key, (_, schema) in (
+                *DAY_SENSORS.items(),
+                *DAY_TEXT_SENSORS.items(),
+            )
+        }
+    )
+    .extend(
+        {
+            cv.Optional(f"{ep}_{key}"): schema
+            for ep in ENDPOINTS
+            for key, (_, schema) in (
+                *ENDPOINT_SENSORS.items(),
+                *ENDPOINT_TEXT_SENSORS.items(),
+                *ENDPOINT_TELEMETRY.items(),
+            )
+        }
+    )
+    .extend(cv.polling_component_schema("300s")),
     _validate_location,
+    _validate_forecast_days,
+    _validate_forecast_hours,
+    _validate_endpoints,
+    _validate_retry,
+    _validate_transport,
+    _validate_battery,
 )
 
 
+def _final_validate(config):
+    blocks = fv.full_config.get()[DOMAIN]
+    for key in ENGINE_OPTIONS:
+        values = {block[key] for block in blocks if key in block}
+        if len(values) > 1:
+            raise cv.Invalid(
+                f"{key} configures the fetch task shared by all {DOMAIN} "
+                f"blocks; set it once (got {sorted(values)})"
+            )
+    # The RTC state is sized for one block, and only one can decide when
+    # the device sleeps
+    if sum(CONF_DEEP_SLEEP_ID in block for block in blocks) > 1:
+        raise cv.Invalid(
+            f"Only one {DOMAIN} block can use {CONF_DEEP_SLEEP_ID}"
+        )
+    return config
+
+
+FINAL_VALIDATE_SCHEMA = _final_validate
+
+
+async def _get_engine(config):
+    """The FetchEngine, created with the first block that asks for it."""
+    data = CORE.data.setdefault(DOMAIN, {})
+    if (engine := data.get(CONF_ENGINE_ID)) is None:
+        engine = cg.new_Pvariable(config[CONF_ENGINE_ID])
+        await cg.register_component(engine, {})
+        data[CONF_ENGINE_ID] = engine
+    return engine
+
+
+async def _get_snapshot_server(config):
+    """The SnapshotServer, created with the first block served."""
+    data = CORE.data.setdefault(DOMAIN, {})
+    if (server := data.get(CONF_SNAPSHOT_SERVER_ID)) is None:
+        server = cg.new_Pvariable(config[CONF_SNAPSHOT_SERVER_ID])
+        await cg.register_component(server, {})
+        cg.add_define("WEATHER_BOM_SNAPSHOT_SERVER")
+        data[CONF_SNAPSHOT_SERVER_ID] = server
+    return server
+
+
 async def to_code(config):
+    engine = await _get_engine(config)
     var = cg.new_Pvariable(config[CONF_ID])
     await cg.register_component(var, config)
+    cg.add(engine.add_location(var))
+    cg.add(var.set_snapshot_key(str(config[CONF_ID].id)))
+
+    if CORE.using_esp_idf:
+        # Lets the shared HTTP client resume TLS sessions between fetch cycles
+        esp32.add_idf_sdkconfig_option(
+            "CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS", True
+        )
+
+    cg.add(var.set_api_base_url(config[CONF_API_BASE_URL]))
+    if CONF_SNAPSHOT_URL in config:
+        cg.add(var.set_snapshot_url(config[CONF_SNAPSHOT_URL]))
+    if config[CONF_SERVE_SNAPSHOT]:
+        server = await _get_snapshot_server(config)
+        cg.add(server.add_location(var, str(config[CONF_ID].id)))
+    # Each endpoint is only requested, and only built in, for blocks with
+    # entities that use it
+    endpoints = _endpoints_used(config)
+    cg.add(var.set_endpoints(sum(1 << ENDPOINT_BITS[ep] for ep in endpoints)))
+    for ep in endpoints:
+        cg.add_define(f"WEATHER_BOM_FETCH_{ep.upper()}")
+    cg.add(var.set_warm_start(config[CONF_WARM_START]))
+    if CONF_DEEP_SLEEP_ID in config:
+        cg.add_define("WEATHER_BOM_BATTERY")
+        sleeper = await cg.get_variable(config[CONF_DEEP_SLEEP_ID])
+        cg.add(var.set_deep_sleep(sleeper))
+    for key in ENGINE_OPTIONS:
+        if key in config:
+            cg.add(getattr(engine, f"set_{key}")(config[key]))
+    if config[CONF_COUNT_ALLOCATIONS]:
+        cg.add_define("WEATHER_BOM_COUNT_ALLOCATIONS")
+    if config.get(CONF_GZIP):
+        # The inflater is only compiled in when asked for: miniz from ROM on
+        # the ESP32, zlib on the host
+        cg.add_define("WEATHER_BOM_GZIP")
+        if CORE.is_host:
+            cg.add_build_flag("-lz")
 
     if CONF_GEOHASH in config:
         cg.add(var.set_geohash(config[CONF_GEOHASH]))
@@ -214,6 +823,10 @@ async def to_code(config):
     if CONF_LON_SENSOR in config:
         lon_s = await cg.get_variable(config[CONF_LON_SENSOR])
         cg.add(var.set_lon_sensor(lon_s))
+    if CONF_MOVEMENT_THRESHOLD in config:
+        cg.add(var.set_movement_threshold(config[CONF_MOVEMENT_THRESHOLD]))
+    if CONF_MOVEMENT_DEBOUNCE in config:
+        cg.add(var.set_movement_debounce(config[CONF_MOVEMENT_DEBOUNCE]))
 
     async def _reg(name, fn):
         if name in config:
@@ -230,31 +843,76 @@ async def to_code(config):
     await _reg(CONF_HUMIDITY, "set_humidity_sensor")
     await _reg(CONF_WIND_KMH, "set_wind_kmh_sensor")
     await _reg(CONF_RAIN_SINCE_9AM, "set_rain_since_9am_sensor")
+    history = [key for key in HISTORY_SENSORS if key in config]
+    if history or CONF_HISTORY_INTERVAL in config:
+        interval = config.get(CONF_HISTORY_INTERVAL, DEFAULT_HISTORY_INTERVAL)
+        cg.add(var.set_history_interval(interval.total_milliseconds))
+    for key in history:
+        sens = await sensor.new_sensor(config[key])
+        cg.add(var.set_history_sensor(HISTORY_SENSORS[key][0], sens))
 
-    # Today
-    await _reg(CONF_TODAY_MIN, "set_today_min_sensor")
-    await _reg(CONF_TODAY_MAX, "set_today_max_sensor")
-    await _reg(CONF_TODAY_RAIN_CHANCE, "set_today_rain_chance_sensor")
-    await _reg_text(CONF_TODAY_SUMMARY, "set_today_summary_text")
-    await _reg_text(CONF_TODAY_ICON, "set_today_icon_text")
-    await _reg(CONF_TODAY_RAIN_MIN, "set_today_rain_min_sensor")
-    await _reg(CONF_TODAY_RAIN_MAX, "set_today_rain_max_sensor")
-    await _reg_text(CONF_TODAY_SUNRISE, "set_today_sunrise_text")
-    await _reg_text(CONF_TODAY_SUNSET, "set_today_sunset_text")
-
-    # Tomorrow
-    await _reg(CONF_TOMORROW_MIN, "set_tomorrow_min_sensor")
-    await _reg(CONF_TOMORROW_MAX, "set_tomorrow_max_sensor")
-    await _reg(CONF_TOMORROW_RAIN_CHANCE, "set_tomorrow_rain_chance_sensor")
-    await _reg_text(CONF_TOMORROW_SUMMARY, "set_tomorrow_summary_text")
-    await _reg_text(CONF_TOMORROW_ICON, "set_tomorrow_icon_text")
-    await _reg(CONF_TOMORROW_RAIN_MIN, "set_tomorrow_rain_min_sensor")
-    await _reg(CONF_TOMORROW_RAIN_MAX, "set_tomorrow_rain_max_sensor")
-    await _reg_text(CONF_TOMORROW_SUNRISE, "set_tomorrow_sunrise_text")
-    await _reg_text(CONF_TOMORROW_SUNSET, "set_tomorrow_sunset_text")
+    # Forecast
+    for day, key, conf in _forecast_day_entities(config):
+        if key in DAY_SENSORS:
+            sens = await sensor.new_sensor(conf)
+            cg.add(var.set_day_sensor(day, DAY_SENSORS[key][0], sens))
+        else:
+            text = await text_sensor.new_text_sensor(conf)
+            cg.add(var.set_day_text_sensor(day, DAY_TEXT_SENSORS[key][0], text))
 
-    # Meta
+    cg.add(var.set_hourly_hours(config[CONF_HOURLY_HOURS]))
+    for entry in config.get(CONF_FORECAST_HOURS, []):
+        for key, (field, _) in HOURLY_SENSORS.items():
+            if conf := entry.get(key):
+                sens = await sensor.new_sensor(conf)
+                cg.add(var.add_hourly_sensor(entry[CONF_HOURS], field, sens))
+
+    # Warnings
     await _reg_text(CONF_WARNINGS_JSON, "set_warnings_json_text")
+    await _reg(CONF_WARNINGS_COUNT, "set_warnings_count_sensor")
+    await _reg(CONF_WARNINGS_MAX_SEVERITY, "set_warnings_max_severity_sensor")
+    for conf in config.get(CONF_ON_NEW_WARNING, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(
+            trigger, [(WarningData.operator("ref").operator("const"), "warning")], conf
+        )
+
+    # Meta
     await _reg_text(CONF_LOCATION_NAME, "set_location_name_text")
     await _reg_text(CONF_OUT_GEOHASH, "set_out_geohash_text")
     await _reg_text(CONF_LAST_UPDATE, "set_last_update_text")
+    if conf := config.get(CONF_DATA_STALE):
+        bs = await binary_sensor.new_binary_sensor(conf)
+        cg.add(var.set_data_stale_binary_sensor(bs))
+
+    # Diagnostics
+    await _reg(CONF_TLS_HANDSHAKES_AVOIDED, "set_handshakes_avoided_sensor")
+    await _reg(CONF_PUBLISHES_SUPPRESSED, "set_publishes_suppressed_sensor")
+    await _reg(CONF_TASK_STACK_FREE, "set_task_stack_free_sensor")
+    await _reg(CONF_HEAP_MIN_FREE, "set_heap_min_free_sensor")
+    await _reg(CONF_HEAP_LARGEST_BLOCK, "set_heap_largest_block_sensor")
+    await _reg(CONF_HEAP_BLOCK_BEFORE, "set_heap_block_before_sensor")
+    await _reg(CONF_HEAP_BLOCK_AFTER, "set_heap_block_after_sensor")
+    await _reg(CONF_PARSE_ARENA_USED, "set_arena_used_sensor")
+    await _reg(CONF_PARSE_ARENA_FALLBACKS, "set_arena_fallbacks_sensor")
+    await _reg(CONF_AWAKE_TIME, "set_awake_time_sensor")
+    await _reg(CONF_TIME_TO_FIRST_DATA, "set_first_data_time_sensor")
+
+    cg.add(var.set_retry_initial(config[CONF_RETRY_INITIAL]))
+    cg.add(var.set_retry_max(config[CONF_RETRY_MAX]))
+    cg.add(var.set_breaker_threshold(config[CONF_BREAKER_THRESHOLD]))
+    for ep, ep_id in ENDPOINTS.items():
+        if (interval := config.get(f"{ep}_{CONF_INTERVAL}")) is not None:
+            cg.add(var.set_endpoint_interval(ep_id, interval))
+        for key, (setter, _) in ENDPOINT_SENSORS.items():
+            if conf := config.get(f"{ep}_{key}"):
+                sens = await sensor.new_sensor(conf)
+                cg.add(getattr(var, setter)(ep_id, sens))
+        for key, (setter, _) in ENDPOINT_TEXT_SENSORS.items():
+            if conf := config.get(f"{ep}_{key}"):
+                text = await text_sensor.new_text_sensor(conf)
+                cg.add(getattr(var, setter)(ep_id, text))
+        for key, (metric, _) in ENDPOINT_TELEMETRY.items():
+            if conf := config.get(f"{ep}_{key}"):
+                sens = await sensor.new_sensor(conf)
+                cg.add(var.set_telemetry_sensor(ep_id, metric, sens))
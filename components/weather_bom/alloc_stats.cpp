@@ -0,0 +1,54 @@
+#include "alloc_stats.h"
+
+#ifdef USE_ESP_IDF
+#include "esp_heap_caps.h"
+#endif
+
+#if defined(USE_HOST) && defined(WEATHER_BOM_COUNT_ALLOCATIONS)
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint32_t> g_alloc_count{0};
+static std::atomic<uint32_t> g_alloc_bytes{0};
+
+void *operator new(size_t size) {
+  g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+  g_alloc_bytes.fetch_add((uint32_t)size, std::memory_order_relaxed);
+  void *p = malloc(size ? size : 1);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+#endif
+
+namespace esphome {
+namespace weather_bom {
+
+#if defined(USE_HOST) && defined(WEATHER_BOM_COUNT_ALLOCATIONS)
+uint32_t alloc_count() { return g_alloc_count.load(std::memory_order_relaxed); }
+uint32_t alloc_bytes() { return g_alloc_bytes.load(std::memory_order_relaxed); }
+#else
+uint32_t alloc_count() { return 0; }
+uint32_t alloc_bytes() { return 0; }
+#endif
+
+#ifdef USE_ESP_IDF
+uint32_t heap_free_bytes() {
+  return heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+uint32_t heap_largest_free_block() {
+  return heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL |
+                                          MALLOC_CAP_8BIT);
+}
+#else
+uint32_t heap_free_bytes() { return 0; }
+uint32_t heap_largest_free_block() { return 0; }
+#endif
+
+}  // namespace weather_bom
+}  // namespace esphome
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+
+#include "esphome/core/defines.h"
+
+namespace esphome {
+namespace weather_bom {
+
+// Process-wide operator new call/byte counters, diffed around do_fetch() to
+// report per-cycle allocations. Only counted on host builds with
+// count_allocations enabled; zero otherwise.
+uint32_t alloc_count();
+uint32_t alloc_bytes();
+
+// Free internal heap and its largest contiguous block right now (ESP-IDF);
+// zero where the platform does not report them.
+uint32_t heap_free_bytes();
+uint32_t heap_largest_free_block();
+
+}  // namespace weather_bom
+}  // namespace esphome
@@ -0,0 +1,212 @@
+#ifdef USE_ESP_IDF
+
+#include "esp_idf_transport.h"
+
+#include <netdb.h>
+#include <strings.h>
+
+#include "esp_crt_bundle.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace weather_bom {
+
+static const char* const TAG = "weather_bom.http";
+
+EspIdfTransport::~EspIdfTransport() {
+  if (this->client_) esp_http_client_cleanup(this->client_);
+}
+
+bool EspIdfTransport::ensure_client_() {
+  if (this->client_) return true;
+
+  esp_http_client_config_t cfg = {};
+  cfg.url = "https://api.weather.bom.gov.au/v1/";
+  cfg.timeout_ms = TIMEOUT_MS;
+  cfg.transport_type = HTTP_TRANSPORT_OVER_SSL;
+  cfg.crt_bundle_attach = esp_crt_bundle_attach;
+  cfg.buffer_size = 4096;
+  cfg.buffer_size_tx = 1024;
+  cfg.event_handler = &EspIdfTransport::event_handler_;
+  cfg.user_data = this;
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+  cfg.save_client_session = true;
+#endif
+
+  this->client_ = esp_http_client_init(&cfg);
+  if (!this->client_) {
+    ESP_LOGE(TAG, "esp_http_client_init failed");
+    return false;
+  }
+  esp_http_client_set_method(this->client_, HTTP_METHOD_GET);
+#ifdef WEATHER_BOM_GZIP
+  if (this->gzip_)
+    esp_http_client_set_header(this->client_, "Accept-Encoding", "gzip");
+#endif
+  return true;
+}
+
+// The CA bundle's index is built on first use; doing it here takes it off
+// the first handshake
+void EspIdfTransport::prepare() {
+  esp_crt_bundle_attach(nullptr);
+  this->ensure_client_();
+}
+
+// lwIP keeps the answer for its TTL, and esp-tls resolves through it
+bool EspIdfTransport::resolve(const std::string& url) {
+  size_t begin = url.find("://");
+  begin = begin == std::string::npos ? 0 : begin + 3;
+  const size_t end = url.find_first_of(":/", begin);
+  const std::string host = url.substr(begin, end - begin);
+
+  const uint32_t start = millis();
+  addrinfo hints{};
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* res = nullptr;
+  const int err = getaddrinfo(host.c_str(), nullptr, &hints, &res);
+  if (err != 0 || res == nullptr) {
+    ESP_LOGW(TAG, "Could not resolve %s (%d)", host.c_str(), err);
+    return false;
+  }
+  freeaddrinfo(res);
+  ESP_LOGD(TAG, "Resolved %s in %u ms", host.c_str(),
+           (unsigned)(millis() - start));
+  return true;
+}
+
+// Drops the socket (and its TLS buffers); the handle and the saved session
+// survive for resumption.
+void EspIdfTransport::close() {
+  if (this->client_) esp_http_client_close(this->client_);
+}
+
+esp_err_t EspIdfTransport::event_handler_(esp_http_client_event_t* evt) {
+  auto* self = static_cast<EspIdfTransport*>(evt->user_data);
+  switch (evt->event_id) {
+    case HTTP_EVENT_ON_CONNECTED:
+      if (self->session_saved_) self->sessions_offered_++;
+      self->connected_us_ = micros();
+      self->timing_.connect_us = self->connected_us_ - self->start_us_;
+      break;
+    case HTTP_EVENT_ON_HEADER:
+      if (self->headers_us_ == 0) self->headers_us_ = micros();
+      if (strcasecmp(evt->header_key, "ETag") == 0) {
+        self->received_.etag = evt->header_value;
+      } else if (strcasecmp(evt->header_key, "Last-Modified") == 0) {
+        self->received_.last_modified = evt->header_value;
+      } else if (strcasecmp(evt->header_key, "Content-Encoding") == 0) {
+        self->content_encoding_(evt->header_value);
+      }
+      break;
+    case HTTP_EVENT_ON_DATA:
+      self->body_bytes_ += evt->data_len;
+      if (self->on_data_ == nullptr) break;
+      if (esp_http_client_get_status_code(evt->client) != 200) break;
+      self->deliver_(*self->on_data_, static_cast<const char*>(evt->data),
+                     evt->data_len);
+      break;
+    default:
+      break;
+  }
+  return ESP_OK;
+}
+
+// The handle is shared across endpoints, so conditional headers are set or
+// cleared on every request.
+static void set_or_delete_header(esp_http_client_handle_t client,
+                                 const char* name, const std::string& value) {
+  if (value.empty()) {
+    esp_http_client_delete_header(client, name);
+  } else {
+    esp_http_client_set_header(client, name, value.c_str());
+  }
+}
+
+int EspIdfTransport::get(const std::string& url, const DataCallback& on_data,
+                         HttpValidators* validators) {
+  if (!this->ensure_client_()) return -1;
+
+  esp_err_t err = esp_http_client_set_url(this->client_, url.c_str());
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "set_url failed: %s for %s", esp_err_to_name(err),
+             url.c_str());
+    return -1;
+  }
+
+  static const HttpValidators NONE;
+  const HttpValidators& send = validators ? *validators : NONE;
+  set_or_delete_header(this->client_, "If-None-Match", send.etag);
+  set_or_delete_header(this->client_, "If-Modified-Since", send.last_modified);
+
+  this->on_data_ = &on_data;
+  this->body_bytes_ = 0;
+  this->received_ = HttpValidators{};
+  this->start_timing_();
+  this->begin_body_();
+
+  err = esp_http_client_perform(this->client_);
+  // A dropped idle keep-alive connection fails at once; one that ran into
+  // the timeout is a dead link, and a retry would only wait as long again
+  if (err != ESP_OK && this->body_bytes_ == 0 &&
+      micros() - this->start_us_ < TIMEOUT_MS * 1000u) {
+    ESP_LOGD(TAG, "Request failed (%s), retrying on a new connection",
+             esp_err_to_name(err));
+    esp_http_client_close(this->client_);
+    this->received_ = HttpValidators{};
+    this->start_timing_();
+    this->begin_body_();
+    err = esp_http_client_perform(this->client_);
+  }
+  this->on_data_ = nullptr;
+  this->finish_timing_();
+
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "perform failed: %s for %s", esp_err_to_name(err),
+             url.c_str());
+    esp_http_client_close(this->client_);
+    this->session_saved_ = false;
+    return -1;
+  }
+
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+  this->session_saved_ = true;
+#endif
+  // No ON_CONNECTED during this perform: the connection was already open
+  this->responses_++;
+  if (this->connected_us_ == 0) this->reused_++;
+  int status = esp_http_client_get_status_code(this->client_);
+  ESP_LOGD(TAG, "HTTP status: %d, content_length: %lld for %s", status,
+           (long long)esp_http_client_get_content_length(this->client_),
+           url.c_str());
+  if (status == 200 && !this->body_complete_()) {
+    ESP_LOGW(TAG, "Incomplete gzip body for %s", url.c_str());
+    esp_http_client_close(this->client_);
+    return -1;
+  }
+  if (status == 200 && validators) *validators = std::move(this->received_);
+  return status;
+}
+
+void EspIdfTransport::start_timing_() {
+  this->timing_ = HttpTiming{};
+  this->start_us_ = micros();
+  this->connected_us_ = 0;
+  this->headers_us_ = 0;
+}
+
+void EspIdfTransport::finish_timing_() {
+  const uint32_t end = micros();
+  if (this->headers_us_ == 0) this->headers_us_ = end;
+  const uint32_t sent =
+      this->connected_us_ ? this->connected_us_ : this->start_us_;
+  this->timing_.ttfb_us = this->headers_us_ - sent;
+  this->timing_.download_us = end - this->headers_us_;
+  this->timing_.body_bytes = this->body_bytes_;
+}
+
+}  // namespace weather_bom
+}  // namespace esphome
+
+#endif  // USE_ESP_IDF
@@ -0,0 +1,47 @@
+#pragma once
+#ifdef USE_ESP_IDF
+
+#include "esp_http_client.h"
+#include "http_transport.h"
+
+namespace esphome {
+namespace weather_bom {
+
+// esp_http_client over TLS with the system CA bundle. One client handle lives
+// as long as the transport: requests share its keep-alive connection, and the
+// saved TLS session lets the first request after close() resume instead of
+// doing a full handshake.
+class EspIdfTransport : public HttpTransport {
+ public:
+  ~EspIdfTransport() override;
+
+  int get(const std::string &url, const DataCallback &on_data,
+          HttpValidators *validators = nullptr) override;
+  void close() override;
+  void prepare() override;
+  bool resolve(const std::string &url) override;
+
+ protected:
+  static constexpr int TIMEOUT_MS = 5000;
+
+  bool ensure_client_();
+  void start_timing_();
+  void finish_timing_();
+  static esp_err_t event_handler_(esp_http_client_event_t *evt);
+
+  esp_http_client_handle_t client_{nullptr};
+  const DataCallback *on_data_{nullptr};
+  HttpValidators received_;
+  size_t body_bytes_{0};
+  // The last connection completed a request, so esp-tls saved its session
+  // and offers it on the next one
+  bool session_saved_{false};
+  uint32_t start_us_{0};
+  uint32_t connected_us_{0};
+  uint32_t headers_us_{0};
+};
+
+}  // namespace weather_bom
+}  // namespace esphome
+
+#endif  // USE_ESP_IDF
@@ -0,0 +1,487 @@
+#include "fetch_engine.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "alloc_stats.h"
+#include "esphome/components/network/util.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+#ifdef USE_ESP_IDF
+#include "esp_event.h"
+#include "esp_idf_transport.h"
+#include "esp_netif_types.h"
+#endif
+#ifdef USE_HOST
+#include "posix_transport.h"
+#endif
+
+namespace esphome {
+namespace weather_bom {
+
+static const char* const TAG = "weather_bom.engine";
+
+// Free heap never handed to extra connections, whatever the budget
+static constexpr uint32_t HEAP_RESERVE = 24 * 1024;
+
+void FetchEngine::add_location(WeatherBOM* location) {
+  location->set_engine(this);
+  this->all_.push_back(location);
+}
+
+std::unique_ptr<HttpTransport> FetchEngine::make_transport_() {
+#ifdef USE_ESP_IDF
+  return std::make_unique<EspIdfTransport>();
+#elif defined(USE_HOST)
+  return std::make_unique<PosixTransport>();
+#else
+  return nullptr;
+#endif
+}
+
+void FetchEngine::setup() {
+  this->locations_.load();
+  // Taken first, like the worker below, while the heap is in one piece
+  if (this->arena_size_ != 0 && !this->arena_.init(this->arena_size_))
+    ESP_LOGW(TAG, "No memory for a %u byte parse arena; parsing on the heap",
+             (unsigned)this->arena_size_);
+
+  if (!this->transport_) this->transport_ = make_transport_();
+  for (uint8_t i = 0; i + 1 < this->max_lanes_; i++) {
+    this->lanes_[i].engine = this;
+    this->lanes_[i].transport = make_transport_();
+  }
+#ifdef WEATHER_BOM_GZIP
+  // Windows taken up front too; a connection without one fetches plain
+  if (this->gzip_) {
+    bool ok = this->transport_->enable_gzip();
+    for (uint8_t i = 0; i + 1 < this->max_lanes_; i++)
+      ok = this->lanes_[i].transport->enable_gzip() && ok;
+    if (!ok) ESP_LOGW(TAG, "No memory for gzip on every connection");
+  }
+#endif
+
+#ifdef USE_ESP_IDF
+  // Created once, while the heap is still unfragmented
+  this->start_worker_();
+#endif
+}
+
+void FetchEngine::dump_config() {
+  ESP_LOGCONFIG(TAG, "Weather BOM Fetch Engine:");
+  ESP_LOGCONFIG(TAG, "  Locations: %u", (unsigned)this->all_.size());
+  if (this->arena_.enabled()) {
+    ESP_LOGCONFIG(TAG, "  Parse Arena: %u bytes in %s",
+                  (unsigned)this->arena_.size(),
+                  this->arena_.in_psram() ? "PSRAM" : "internal RAM");
+  }
+#ifdef WEATHER_BOM_GZIP
+  ESP_LOGCONFIG(TAG, "  Gzip: %s",
+                YESNO(this->transport_ && this->transport_->gzip_enabled()));
+#endif
+#ifdef USE_ESP_IDF
+  ESP_LOGCONFIG(TAG, "  Task: %u bytes stack, priority %u, core %s",
+                (unsigned)this->task_stack_size_,
+                (unsigned)this->task_priority_,
+                this->task_core_ < 0 ? "any" : this->task_core_ ? "1" : "0");
+  if (this->max_lanes_ > 1) {
+    ESP_LOGCONFIG(TAG, "  Concurrent Fetches: up to %u, %u bytes heap budget",
+                  this->max_lanes_, (unsigned)this->heap_budget_);
+  }
+#endif
+}
+
+void FetchEngine::loop() {
+  if (this->running_.load(std::memory_order_acquire)) return;
+  // Preferences are not thread-safe; persist what the last cycle learned here
+  this->locations_.save_if_dirty();
+  this->start_cycle_();
+}
+
+void FetchEngine::start_cycle_() {
+  bool requested = false;
+  for (auto* loc : this->all_) requested |= loc->requested_mask_ != 0;
+  if (!requested) return;
+#ifdef USE_ESP_IDF
+  if (this->worker_ == nullptr && !this->start_worker_()) return;
+#endif
+
+  // Blocks on a geohash that is being fetched anyway come along, so each
+  // distinct geohash is fetched once and their timers stay in step
+  for (auto* a : this->all_) {
+    if (a->requested_mask_ == 0 || a->geohash_.empty()) continue;
+    for (auto* b : this->all_) {
+      if (b != a && b->geohash_ == a->geohash_)
+        b->requested_mask_ |= a->requested_mask_ & b->enabled_mask_;
+    }
+  }
+
+  this->cycle_.clear();
+  for (auto* loc : this->all_) {
+    if (loc->requested_mask_ == 0) continue;
+    loc->begin_cycle_(loc->requested_mask_);
+    loc->requested_mask_ = 0;
+    this->cycle_.push_back(loc);
+  }
+
+#ifdef USE_HOST
+  // No FreeRTOS on the host build; fetch inline
+  this->running_ = true;
+  this->run_cycle_();
+  this->running_ = false;
+#else
+  // Released by the worker once every block's results are in place
+  this->running_.store(true, std::memory_order_release);
+  xTaskNotifyGive(this->worker_);
+#endif
+}
+
+// Connections are closed at the end of the cycle
+void FetchEngine::run_cycle_() {
+  const uint32_t cycle_start = millis();
+#ifdef WEATHER_BOM_COUNT_ALLOCATIONS
+  const uint32_t allocs_start = alloc_count();
+  const uint32_t alloc_bytes_start = alloc_bytes();
+#endif
+  const uint32_t free_at_start = heap_free_bytes();
+  const uint32_t block_at_start = heap_largest_free_block();
+  this->heap_low_.store(0, std::memory_order_relaxed);
+  this->block_low_.store(0, std::memory_order_relaxed);
+  this->sample_heap();
+
+  uint8_t lanes = this->lanes_for_cycle_();
+  if (lanes > 1) {
+    lanes = this->run_concurrent_(lanes);
+  } else {
+    for (auto* loc : this->cycle_) loc->do_fetch(this->transport_.get());
+  }
+  this->transport_->close();
+  for (auto& lane : this->lanes_) {
+    if (lane.transport) lane.transport->close();
+  }
+  this->arena_.reset();
+  // With everything of the cycle released: what it left behind
+  const uint32_t block_at_end = heap_largest_free_block();
+
+  const uint32_t heap_free = this->heap_low_.load(std::memory_order_relaxed);
+  const uint32_t heap_block = this->block_low_.load(std::memory_order_relaxed);
+  if (free_at_start != 0 && heap_free != 0 && heap_free < free_at_start) {
+    // Mostly TLS buffers, held once per open connection. Decays slowly, so
+    // one lean cycle does not let the next open more than the heap can take.
+    const uint32_t cost = (free_at_start - heap_free) / lanes;
+    this->lane_cost_ = std::max(cost, this->lane_cost_ - this->lane_cost_ / 8);
+  }
+  uint32_t stack_free = 0;
+#ifdef USE_ESP_IDF
+  stack_free = uxTaskGetStackHighWaterMark(nullptr);
+  for (uint8_t i = 0; i + 1 < lanes; i++) {
+    stack_free = std::min<uint32_t>(
+        stack_free, uxTaskGetStackHighWaterMark(this->lanes_[i].task));
+  }
+#endif
+  for (auto* loc : this->cycle_) {
+    loc->work_->heap_free = heap_free;
+    loc->work_->heap_block = heap_block;
+    loc->work_->stack_free = stack_free;
+    loc->work_->heap_block_before = block_at_start;
+    loc->work_->heap_block_after = block_at_end;
+    loc->work_->arena_used = this->arena_.last_used();
+    loc->work_->arena_fallbacks = this->arena_.fallbacks();
+  }
+
+  ESP_LOGD(TAG,
+           "%u handshakes avoided so far; %u new connections offered a saved "
+           "TLS session",
+           (unsigned)this->handshakes_avoided(),
+           (unsigned)this->sessions_offered());
+  if (heap_free != 0) {
+    ESP_LOGD(TAG, "Heap low-water: %u bytes free, %u largest block",
+             (unsigned)heap_free, (unsigned)heap_block);
+    ESP_LOGD(TAG, "Largest free block: %u before the cycle, %u after",
+             (unsigned)block_at_start, (unsigned)block_at_end);
+  }
+  if (this->arena_.enabled()) {
+    ESP_LOGD(TAG, "Parse arena: %u of %u bytes used, %u fallbacks so far",
+             (unsigned)this->arena_.last_used(), (unsigned)this->arena_.size(),
+             (unsigned)this->arena_.fallbacks());
+  }
+#ifdef WEATHER_BOM_COUNT_ALLOCATIONS
+  ESP_LOGI(TAG, "Fetch cycle took %u ms, %u allocations (%u bytes)",
+           (unsigned)(millis() - cycle_start),
+           (unsigned)(alloc_count() - allocs_start),
+           (unsigned)(alloc_bytes() - alloc_bytes_start));
+#else
+  ESP_LOGD(TAG, "Fetch cycle took %u ms over %u connection(s)",
+           (unsigned)(millis() - cycle_start), lanes);
+#endif
+
+  // Not before: fetched_by() reads earlier blocks' buffers
+  for (auto* loc : this->cycle_)
+    loc->running_.store(false, std::memory_order_release);
+}
+
+// As many connections as the budget, the free heap above HEAP_RESERVE and
+// the running helpers allow; 1 (sequential) until a cycle has measured what
+// a connection costs
+uint8_t FetchEngine::lanes_for_cycle_() const {
+  uint8_t lanes = 1;
+#ifdef USE_ESP_IDF
+  while (lanes < this->max_lanes_ && this->lanes_[lanes - 1].task != nullptr)
+    lanes++;
+#endif
+  if (lanes == 1 || this->lane_cost_ == 0) return 1;
+  const uint32_t free_bytes = heap_free_bytes();
+  if (free_bytes <= HEAP_RESERVE) return 1;
+  const uint32_t budget =
+      std::min(this->heap_budget_, free_bytes - HEAP_RESERVE);
+  const uint32_t fit = budget / this->lane_cost_;
+  if (fit < lanes) {
+    ESP_LOGD(TAG, "Heap allows %u of %u connections (%u bytes free, ~%u each)",
+             (unsigned)std::max<uint32_t>(fit, 1), lanes, (unsigned)free_bytes,
+             (unsigned)this->lane_cost_);
+    lanes = std::max<uint32_t>(fit, 1);
+  }
+  return lanes;
+}
+
+// Locations are resolved (and snapshot clients fetched) first, on the
+// worker's connection. Each endpoint that no earlier block in the cycle also
+// wants becomes a job, and the jobs are spread over the lanes; the endpoints
+// left over are then shared (or, if the first fetch failed, requested) in
+// cycle order as in do_fetch().
+// Returns the number of connections used.
+uint8_t FetchEngine::run_concurrent_(uint8_t lanes) {
+  HttpTransport* main = this->transport_.get();
+  this->ready_.clear();
+  for (auto* loc : this->cycle_) {
+    if (!loc->snapshot_url_.empty()) {
+      loc->do_fetch(main);  // one request whatever the endpoints: no jobs
+    } else if (loc->begin_fetch_(main)) {
+      this->ready_.push_back(loc);
+    }
+  }
+
+  const auto covered = [this](const WeatherBOM* loc, Endpoint ep) {
+    for (const auto* other : this->ready_) {
+      if (other == loc) break;
+      if ((other->work_->fetched & (1 << ep)) && same_source_(other, loc, ep))
+        return true;
+    }
+    return false;
+  };
+  this->jobs_.clear();
+  for (auto* loc : this->ready_) {
+    for (uint8_t i = 0; i < ENDPOINT_COUNT; i++) {
+      const Endpoint ep = (Endpoint)i;
+      if ((loc->work_->fetched & (1 << ep)) && !covered(loc, ep))
+        this->jobs_.push_back({loc, ep, FetchResult::FAILED});
+    }
+  }
+
+  if (lanes > this->jobs_.size())
+    lanes = std::max<size_t>(this->jobs_.size(), 1);
+  this->next_job_.store(0, std::memory_order_relaxed);
+#ifdef USE_ESP_IDF
+  for (uint8_t i = 0; i + 1 < lanes; i++) xTaskNotifyGive(this->lanes_[i].task);
+#endif
+  this->run_jobs_(main);
+#ifdef USE_ESP_IDF
+  // One notification back from each helper
+  for (uint8_t i = 0; i + 1 < lanes; i++)
+    ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+#endif
+
+  for (const auto& job : this->jobs_)
+    job.location->note_result_(job.endpoint, job.result);
+  for (auto* loc : this->ready_) {
+    for (uint8_t i = 0; i < ENDPOINT_COUNT; i++) {
+      const Endpoint ep = (Endpoint)i;
+      if ((loc->work_->fetched & (1 << ep)) && covered(loc, ep) &&
+          !loc->share_(ep))
+        loc->note_result_(ep, loc->fetch_endpoint_(ep, main));
+    }
+    loc->end_fetch_();
+  }
+  return lanes;
+}
+
+// Takes jobs until none are left; runs on every lane at once
+void FetchEngine::run_jobs_(HttpTransport* transport) {
+  uint32_t i;
+  while ((i = this->next_job_.fetch_add(1, std::memory_order_relaxed)) <
+         this->jobs_.size()) {
+    Job& job = this->jobs_[i];
+    job.result = job.location->fetch_endpoint_(job.endpoint, transport);
+  }
+}
+
+bool FetchEngine::same_source_(const WeatherBOM* a, const WeatherBOM* b,
+                               Endpoint ep) {
+  if (a->geohash_ != b->geohash_ || a->api_base_url_ != b->api_base_url_)
+    return false;
+  return ep != ENDPOINT_HOURLY || a->hourly_hours_ == b->hourly_hours_;
+}
+
+const WeatherBOM* FetchEngine::fetched_by(const WeatherBOM* location,
+                                          Endpoint ep) const {
+  for (const auto* other : this->cycle_) {
+    if (other == location) break;  // later blocks have not run yet
+    if ((other->work_->refreshed & (1 << ep)) &&
+        same_source_(other, location, ep))
+      return other;
+  }
+  return nullptr;
+}
+
+uint32_t FetchEngine::handshakes_avoided() const {
+  uint32_t n = this->transport_->reused();
+  for (const auto& lane : this->lanes_) {
+    if (lane.transport) n += lane.transport->reused();
+  }
+  return n;
+}
+
+uint32_t FetchEngine::sessions_offered() const {
+  uint32_t n = this->transport_->sessions_offered();
+  for (const auto& lane : this->lanes_) {
+    if (lane.transport) n += lane.transport->sessions_offered();
+  }
+  return n;
+}
+
+void FetchEngine::sample_heap() {
+  const auto lower = [](std::atomic<uint32_t>& low, uint32_t v) {
+    uint32_t cur = low.load(std::memory_order_relaxed);
+    while ((cur == 0 || v < cur) &&
+           !low.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {
+    }
+  };
+  lower(this->heap_low_, heap_free_bytes());
+  lower(this->block_low_, heap_largest_free_block());
+}
+
+#ifdef USE_ESP_IDF
+bool FetchEngine::start_worker_() {
+  BaseType_t core = this->task_core_ < 0 ? tskNO_AFFINITY : this->task_core_;
+  BaseType_t res = xTaskCreatePinnedToCore(
+      &FetchEngine::worker_task, "bom_fetch", this->task_stack_size_, this,
+      this->task_priority_, &this->worker_, core);
+  if (res != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create bom_fetch task (err=%ld), %u bytes stack",
+             (long)res, (unsigned)this->task_stack_size_);
+    this->worker_ = nullptr;
+    return false;
+  }
+
+  // Helpers that fail to start just leave fewer connections to use
+  for (uint8_t i = 0; i + 1 < this->max_lanes_; i++) {
+    Lane& lane = this->lanes_[i];
+    if (lane.task != nullptr) continue;
+    char name[16];
+    snprintf(name, sizeof(name), "bom_fetch%u", i + 1);
+    if (xTaskCreatePinnedToCore(&FetchEngine::helper_task, name,
+                                this->task_stack_size_, &lane,
+                                this->task_priority_, &lane.task,
+                                core) != pdPASS) {
+      ESP_LOGW(TAG, "Failed to create %s task; %u concurrent fetches at most",
+               name, i + 1);
+      lane.task = nullptr;
+      break;
+    }
+  }
+  return true;
+}
+
+// Set in the worker's notification value when the interface gets an
+// address, above any count of cycle requests
+static constexpr uint32_t NOTIFY_NETWORK_UP = 1UL << 31;
+
+static void on_got_ip(void* arg, esp_event_base_t /*base*/, int32_t /*id*/,
+                      void* /*data*/) {
+  xTaskNotify(static_cast<TaskHandle_t>(arg), NOTIFY_NETWORK_UP, eSetBits);
+}
+
+// Lives for the lifetime of the component; each notification is one fetch
+// cycle over cycle_
+void FetchEngine::worker_task(void* pv) {
+  auto* self = static_cast<FetchEngine*>(pv);
+  bool notified = self->prewarm_();
+  while (true) {
+    // Only loop()'s notifications ask for a cycle; a network-up bit set as
+    // the warm-up ended is dropped
+    if (!notified &&
+        (ulTaskNotifyTake(pdTRUE, portMAX_DELAY) & ~NOTIFY_NETWORK_UP) == 0)
+      continue;
+    notified = false;
+    self->run_cycle_();
+    self->running_.store(false, std::memory_order_release);
+  }
+}
+
+// Once, as the worker starts during setup: what the first request needs
+// that takes no network is done while WiFi associates, and the API host is
+// looked up the moment the network is up, so the first cycle connects
+// without waiting on DNS. True if a cycle was asked for meanwhile; the
+// lookup is then left to it.
+bool FetchEngine::prewarm_() {
+  const uint32_t start = millis();
+  this->transport_->prepare();
+  for (auto& lane : this->lanes_) {
+    if (lane.transport) lane.transport->prepare();
+  }
+  ESP_LOGD(TAG, "Connections prepared in %u ms", (unsigned)(millis() - start));
+
+  // Snapshot clients talk plain HTTP to a LAN host
+  const WeatherBOM* bom = nullptr;
+  for (auto* loc : this->all_) {
+    if (loc->snapshot_url_.empty()) {
+      bom = loc;
+      break;
+    }
+  }
+  if (bom == nullptr) return false;
+
+  // Sleeps until the IP event; the network component only reports
+  // connected from its next loop(), later
+  static constexpr int32_t GOT_IP[] = {IP_EVENT_STA_GOT_IP,
+                                       IP_EVENT_ETH_GOT_IP};
+  esp_event_handler_instance_t handlers[2]{};
+  for (uint8_t i = 0; i < 2; i++)
+    esp_event_handler_instance_register(IP_EVENT, GOT_IP[i], &on_got_ip,
+                                        xTaskGetCurrentTaskHandle(),
+                                        &handlers[i]);
+  bool requested = false;
+  while (!network::is_connected()) {
+    // The timeout covers interfaces without these events
+    const uint32_t v = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+    requested = (v & ~NOTIFY_NETWORK_UP) != 0;
+    if (requested || (v & NOTIFY_NETWORK_UP)) break;
+  }
+  for (uint8_t i = 0; i < 2; i++) {
+    if (handlers[i] != nullptr)
+      esp_event_handler_instance_unregister(IP_EVENT, GOT_IP[i], handlers[i]);
+  }
+  if (requested) {
+    ESP_LOGD(TAG, "Cycle asked for before the network was up; no warm-up");
+    return true;
+  }
+  if (this->transport_->resolve(bom->api_base_url_))
+    this->prewarm_resolved_ms_ = millis();
+  return false;
+}
+
+// Each notification is a share of the worker's job list on its own
+// connection; the worker is notified back once the list is empty
+void FetchEngine::helper_task(void* pv) {
+  auto* lane = static_cast<Lane*>(pv);
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    lane->engine->run_jobs_(lane->transport.get());
+    xTaskNotifyGive(lane->engine->worker_);
+  }
+}
+#endif
+
+}  // namespace weather_bom
+}  // namespace esphome
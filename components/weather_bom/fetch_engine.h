@@ -0,0 +1,141 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "esphome/core/component.h"
+#ifdef USE_ESP_IDF
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#endif
+#include "http_transport.h"
+#include "location_cache.h"
+#include "parse_arena.h"
+#include "weather_bom.h"
+
+namespace esphome {
+namespace weather_bom {
+
+// Runs the fetches of every weather_bom block: one worker task, one HTTP
+// connection and one location cache, whatever the number of locations.
+// Blocks ask for endpoints from their loop(); whatever has been asked for
+// when the worker is free goes into one cycle, fetched location by location
+// over the same connection. A block whose geohash another block in the cycle
+// already fetched copies that result instead of requesting it again, and
+// blocks sharing a geohash are pulled into each other's cycles so their
+// schedules line up.
+//
+// With max_concurrent_fetches above 1, helper tasks with connections of
+// their own take endpoints off the same cycle in parallel, so one slow
+// endpoint no longer holds up the rest. How many connections a cycle opens
+// is decided from the free heap and the cost of a connection measured on
+// earlier cycles; until that is known, or when the heap is short, the cycle
+// runs sequentially as above.
+class FetchEngine : public Component {
+ public:
+  static constexpr uint8_t MAX_LANES = 4;
+
+  void add_location(WeatherBOM *location);
+  // Fetch worker (ESP-IDF); core -1 lets FreeRTOS pick
+  void set_task_stack_size(uint32_t bytes) { task_stack_size_ = bytes; }
+  void set_task_priority(uint8_t p) { task_priority_ = p; }
+  void set_task_core(int8_t core) { task_core_ = core; }
+  // Concurrent fetching (ESP-IDF): at most this many connections at once,
+  // together using at most budget bytes of heap
+  void set_max_concurrent_fetches(uint8_t n) { max_lanes_ = n; }
+  void set_fetch_heap_budget(uint32_t bytes) { heap_budget_ = bytes; }
+  // Bytes set aside at boot for parser state, 0 to parse on the heap
+  void set_parse_arena_size(uint32_t bytes) { arena_size_ = bytes; }
+  // Ask for gzip bodies; each connection then keeps a 32 KB inflate window
+  void set_gzip(bool gzip) { gzip_ = gzip; }
+  // Replaces the platform default (ESP-IDF or POSIX) before setup()
+  void set_transport(std::unique_ptr<HttpTransport> t) {
+    transport_ = std::move(t);
+  }
+
+  void setup() override;
+  void loop() override;
+  void dump_config() override;
+
+  // Worker side, during a cycle
+  LocationCache &locations() { return this->locations_; }
+  ParseArena &arena() { return this->arena_; }
+  // A block earlier in the running cycle that fetched ep for the same
+  // geohash (and, for the hourly forecast, the same horizon), or nullptr
+  const WeatherBOM *fetched_by(const WeatherBOM *location, Endpoint ep) const;
+  // Responses received on an already open connection, over all connections
+  uint32_t handshakes_avoided() const;
+  // New connections that offered a saved TLS session, over all connections
+  uint32_t sessions_offered() const;
+  // Folds the current heap state into the cycle's low-water marks; safe from
+  // any fetch task
+  void sample_heap();
+  // millis() at which the worker's warm-up had the API host resolved, ahead
+  // of the first request; 0 if it did not (a cycle came first)
+  uint32_t prewarm_resolved_ms() const { return this->prewarm_resolved_ms_; }
+
+ protected:
+  // A connection and, past the first, the helper task driving it
+  struct Lane {
+    FetchEngine *engine;
+    std::unique_ptr<HttpTransport> transport;
+#ifdef USE_ESP_IDF
+    TaskHandle_t task{nullptr};
+#endif
+  };
+  // One endpoint of one block, for the concurrent mode
+  struct Job {
+    WeatherBOM *location;
+    Endpoint endpoint;
+    FetchResult result;
+  };
+
+  static std::unique_ptr<HttpTransport> make_transport_();
+  static bool same_source_(const WeatherBOM *a, const WeatherBOM *b,
+                           Endpoint ep);
+  void start_cycle_();
+  void run_cycle_();
+  uint8_t lanes_for_cycle_() const;
+  uint8_t run_concurrent_(uint8_t lanes);
+  void run_jobs_(HttpTransport *transport);
+
+  std::vector<WeatherBOM *> all_;
+  std::vector<WeatherBOM *> cycle_;  // blocks in the running cycle, in order
+  std::unique_ptr<HttpTransport> transport_;
+  LocationCache locations_;
+  uint32_t arena_size_{0};
+  ParseArena arena_;
+  bool gzip_{false};
+  // Set by loop() when a cycle starts, released by the worker at its end
+  std::atomic<bool> running_{false};
+
+  uint32_t task_stack_size_{6144};
+  uint8_t task_priority_{3};
+  int8_t task_core_{-1};
+
+  uint8_t max_lanes_{1};
+  uint32_t heap_budget_{96 * 1024};
+  Lane lanes_[MAX_LANES - 1]{};  // helpers; lane 0 is the worker on transport_
+  std::vector<WeatherBOM *> ready_;  // blocks of the cycle past begin_fetch_()
+  std::vector<Job> jobs_;
+  std::atomic<uint32_t> next_job_{0};
+  // Heap drop per open connection, from earlier cycles; 0 until measured
+  uint32_t lane_cost_{0};
+  std::atomic<uint32_t> heap_low_{0};
+  std::atomic<uint32_t> block_low_{0};
+  // Written by the worker before its first cycle
+  uint32_t prewarm_resolved_ms_{0};
+
+#ifdef USE_ESP_IDF
+  // Persistent fetch worker, woken by task notifications from loop()
+  bool start_worker_();
+  bool prewarm_();
+  static void worker_task(void *pv);
+  static void helper_task(void *pv);
+
+  TaskHandle_t worker_{nullptr};
+#endif
+};
+
+}  // namespace weather_bom
+}  // namespace esphome
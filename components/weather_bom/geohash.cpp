@@ -0,0 +1,35 @@
+#include "geohash.h"
+
+#include <cstdint>
+
+namespace esphome {
+namespace weather_bom {
+
+static const char BASE32[] = "0123456789bcdefghjkmnpqrstuvwxyz";
+
+void geohash_encode(double lat, double lon, size_t precision, char* out) {
+  double lat_lo = -90, lat_hi = 90, lon_lo = -180, lon_hi = 180;
+  bool even = true;  // bits alternate, longitude first
+  for (size_t i = 0; i < precision; i++) {
+    uint8_t idx = 0;
+    for (int bit = 0; bit < 5; bit++) {
+      double& lo = even ? lon_lo : lat_lo;
+      double& hi = even ? lon_hi : lat_hi;
+      double mid = (lo + hi) / 2;
+      double v = even ? lon : lat;
+      idx <<= 1;
+      if (v >= mid) {
+        idx |= 1;
+        lo = mid;
+      } else {
+        hi = mid;
+      }
+      even = !even;
+    }
+    out[i] = BASE32[idx];
+  }
+  out[precision] = '\0';
+}
+
+}  // namespace weather_bom
+}  // namespace esphome
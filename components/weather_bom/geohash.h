@@ -0,0 +1,13 @@
+#pragma once
+#include <cstddef>
+
+namespace esphome {
+namespace weather_bom {
+
+// Writes the base-32 geohash of lat/lon with `precision` characters (plus a
+// terminator) to out, which must hold precision + 1 bytes. BOM locations are
+// addressed by 6-character cells (~1.2 x 0.6 km).
+void geohash_encode(double lat, double lon, size_t precision, char *out);
+
+}  // namespace weather_bom
+}  // namespace esphome
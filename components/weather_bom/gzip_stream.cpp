@@ -0,0 +1,245 @@
+#include "gzip_stream.h"
+#ifdef WEATHER_BOM_GZIP
+
+#ifdef USE_ESP_IDF
+#include "esp_heap_caps.h"
+#if __has_include("rom/miniz.h")
+#include "rom/miniz.h"
+#else
+#include "miniz.h"
+#endif
+#else
+#include <zlib.h>
+#endif
+
+namespace esphome {
+namespace weather_bom {
+
+// FLG bits
+static constexpr uint8_t FHCRC = 0x02;
+static constexpr uint8_t FEXTRA = 0x04;
+static constexpr uint8_t FNAME = 0x08;
+static constexpr uint8_t FCOMMENT = 0x10;
+static constexpr uint8_t FRESERVED = 0xE0;
+
+#ifdef USE_ESP_IDF
+// tinfl inflates straight into the window, which wraps; what it writes is
+// handed to the sink from there, so no further output buffer is needed
+struct Inflater {
+  tinfl_decompressor decomp;
+  uint8_t window[TINFL_LZ_DICT_SIZE];
+};
+static constexpr uint32_t WINDOW_MASK = TINFL_LZ_DICT_SIZE - 1;
+
+GzipStream::~GzipStream() { heap_caps_free(this->backend_); }
+
+bool GzipStream::init() {
+  if (this->backend_ != nullptr) return true;
+  this->backend_ = heap_caps_malloc(sizeof(Inflater), MALLOC_CAP_SPIRAM);
+  this->psram_ = this->backend_ != nullptr;
+  if (this->backend_ == nullptr)
+    this->backend_ = heap_caps_malloc(sizeof(Inflater),
+                                      MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  return this->backend_ != nullptr;
+}
+
+static void reset_inflater(void* backend) {
+  tinfl_init(&static_cast<Inflater*>(backend)->decomp);
+}
+
+bool GzipStream::inflate_(const uint8_t*& data, size_t& len,
+                          const Sink& sink) {
+  auto* inf = static_cast<Inflater*>(this->backend_);
+  while (true) {
+    size_t in_n = len;
+    size_t out_n = TINFL_LZ_DICT_SIZE - this->window_pos_;
+    tinfl_status st = tinfl_decompress(
+        &inf->decomp, data, &in_n, inf->window,
+        inf->window + this->window_pos_, &out_n, TINFL_FLAG_HAS_MORE_INPUT);
+    data += in_n;
+    len -= in_n;
+    if (out_n > 0) {
+      const char* out = (const char*)inf->window + this->window_pos_;
+      this->window_pos_ = (this->window_pos_ + out_n) & WINDOW_MASK;
+      this->decoded_ += out_n;
+      if (!sink(out, out_n)) return false;
+    }
+    if (st < 0) return this->fail_();
+    if (st == TINFL_STATUS_DONE) {
+      this->state_ = STATE_TRAILER;
+      this->count_ = 0;
+      return true;
+    }
+    // Otherwise the window wrapped with more to come
+    if (st == TINFL_STATUS_NEEDS_MORE_INPUT) return true;
+  }
+}
+#else
+// zlib keeps its own window; output passes through a small buffer
+struct Inflater {
+  z_stream zs;
+  char out[1024];
+};
+
+GzipStream::~GzipStream() {
+  auto* inf = static_cast<Inflater*>(this->backend_);
+  if (inf == nullptr) return;
+  inflateEnd(&inf->zs);
+  delete inf;
+}
+
+bool GzipStream::init() {
+  if (this->backend_ != nullptr) return true;
+  auto* inf = new Inflater{};
+  // Raw deflate: the gzip framing is parsed here, as on ESP-IDF
+  if (inflateInit2(&inf->zs, -MAX_WBITS) != Z_OK) {
+    delete inf;
+    return false;
+  }
+  this->backend_ = inf;
+  return true;
+}
+
+static void reset_inflater(void* backend) {
+  inflateReset(&static_cast<Inflater*>(backend)->zs);
+}
+
+bool GzipStream::inflate_(const uint8_t*& data, size_t& len,
+                          const Sink& sink) {
+  auto* inf = static_cast<Inflater*>(this->backend_);
+  z_stream& zs = inf->zs;
+  zs.next_in = const_cast<Bytef*>(data);
+  zs.avail_in = (uInt)len;
+  while (true) {
+    zs.next_out = reinterpret_cast<Bytef*>(inf->out);
+    zs.avail_out = sizeof(inf->out);
+    int rc = inflate(&zs, Z_NO_FLUSH);
+    data += len - zs.avail_in;
+    len = zs.avail_in;
+    size_t out_n = sizeof(inf->out) - zs.avail_out;
+    if (out_n > 0) {
+      this->decoded_ += out_n;
+      if (!sink(inf->out, out_n)) return false;
+    }
+    if (rc == Z_STREAM_END) {
+      this->state_ = STATE_TRAILER;
+      this->count_ = 0;
+      return true;
+    }
+    if (rc != Z_OK && rc != Z_BUF_ERROR) return this->fail_();
+    // Room left in the output: the input is used up
+    if (zs.avail_out != 0) return true;
+  }
+}
+#endif
+
+void GzipStream::begin() {
+  this->state_ = this->backend_ != nullptr ? STATE_HEADER : STATE_FAILED;
+  this->flags_ = 0;
+  this->count_ = 0;
+  this->size_ = 0;
+  this->decoded_ = 0;
+}
+
+bool GzipStream::feed(const char* data, size_t len, const Sink& sink) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+  while (len > 0) {
+    switch (this->state_) {
+      case STATE_DEFLATE:
+        if (!this->inflate_(p, len, sink)) return false;
+        break;
+      case STATE_DONE:
+        return true;  // anything after the first member is ignored
+      case STATE_FAILED:
+        return false;
+      case STATE_TRAILER:
+        len--;
+        if (!this->trailer_byte_(*p++)) return this->fail_();
+        break;
+      default:
+        len--;
+        if (!this->header_byte_(*p++)) return this->fail_();
+        break;
+    }
+  }
+  return true;
+}
+
+bool GzipStream::header_byte_(uint8_t c) {
+  switch (this->state_) {
+    case STATE_HEADER:
+      // ID1 ID2 CM FLG, then MTIME XFL OS which are of no interest
+      if (this->count_ == 0 && c != 0x1F) return false;
+      if (this->count_ == 1 && c != 0x8B) return false;
+      if (this->count_ == 2 && c != 8) return false;  // deflate
+      if (this->count_ == 3) {
+        if (c & FRESERVED) return false;
+        this->flags_ = c;
+      }
+      if (++this->count_ == 10) this->next_field_();
+      return true;
+    case STATE_EXTRA_LEN:
+      this->extra_len_ |= (uint16_t)c << (8 * this->count_);
+      if (++this->count_ == 2) {
+        if (this->extra_len_ == 0) {
+          this->next_field_();
+        } else {
+          this->state_ = STATE_EXTRA;
+        }
+      }
+      return true;
+    case STATE_EXTRA:
+      if (--this->extra_len_ == 0) this->next_field_();
+      return true;
+    case STATE_NAME:
+    case STATE_COMMENT:
+      if (c == 0) this->next_field_();
+      return true;
+    case STATE_HEADER_CRC:
+      if (++this->count_ == 2) this->next_field_();
+      return true;
+    default:
+      return false;
+  }
+}
+
+void GzipStream::next_field_() {
+  this->count_ = 0;
+  if (this->flags_ & FEXTRA) {
+    this->flags_ &= ~FEXTRA;
+    this->extra_len_ = 0;
+    this->state_ = STATE_EXTRA_LEN;
+  } else if (this->flags_ & FNAME) {
+    this->flags_ &= ~FNAME;
+    this->state_ = STATE_NAME;
+  } else if (this->flags_ & FCOMMENT) {
+    this->flags_ &= ~FCOMMENT;
+    this->state_ = STATE_COMMENT;
+  } else if (this->flags_ & FHCRC) {
+    this->flags_ &= ~FHCRC;
+    this->state_ = STATE_HEADER_CRC;
+  } else {
+    reset_inflater(this->backend_);
+    this->window_pos_ = 0;
+    this->state_ = STATE_DEFLATE;
+  }
+}
+
+// CRC32 (not checked), then ISIZE: the inflated length modulo 2^32
+bool GzipStream::trailer_byte_(uint8_t c) {
+  if (this->count_ >= 4) this->size_ |= (uint32_t)c << (8 * (this->count_ - 4));
+  if (++this->count_ < 8) return true;
+  if (this->size_ != this->decoded_) return false;
+  this->state_ = STATE_DONE;
+  return true;
+}
+
+bool GzipStream::fail_() {
+  this->state_ = STATE_FAILED;
+  return false;
+}
+
+}  // namespace weather_bom
+}  // namespace esphome
+
+#endif  // WEATHER_BOM_GZIP
@@ -0,0 +1,78 @@
+#pragma once
+#include "esphome/core/defines.h"
+#ifdef WEATHER_BOM_GZIP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace esphome {
+namespace weather_bom {
+
+// Streaming gzip (RFC 1952) decoder: compressed chunks in, inflated bytes out
+// to a sink as soon as they are decoded, with no buffer for the whole body.
+// The window is fixed at 32 KB and taken once by init(): deflate may refer
+// that far back and a gzip header does not say when the sender used less.
+// Inflates with the miniz tinfl in ROM on ESP-IDF and with zlib on the host.
+//
+// The trailer's length is checked but not its CRC; the JSON parser catches
+// what the length does not, and TLS already guards the transfer.
+class GzipStream {
+ public:
+  using Sink = std::function<bool(const char *data, size_t len)>;
+
+  ~GzipStream();
+  // Allocates the window and decoder state, PSRAM first; false if no memory
+  bool init();
+  bool in_psram() const { return this->psram_; }
+
+  // Starts a new body
+  void begin();
+  // Decodes the next chunk of the body into sink. False on malformed input
+  // (failed() is then set) or once sink returns false.
+  bool feed(const char *data, size_t len, const Sink &sink);
+  // The body has been decoded up to and including its trailer
+  bool done() const { return this->state_ == STATE_DONE; }
+  bool failed() const { return this->state_ == STATE_FAILED; }
+  // Inflated bytes handed to the sink since begin()
+  uint32_t decoded() const { return this->decoded_; }
+
+ protected:
+  enum State : uint8_t {
+    STATE_HEADER,  // fixed 10 bytes
+    STATE_EXTRA_LEN,
+    STATE_EXTRA,
+    STATE_NAME,
+    STATE_COMMENT,
+    STATE_HEADER_CRC,
+    STATE_DEFLATE,
+    STATE_TRAILER,  // CRC32 and ISIZE, 8 bytes
+    STATE_DONE,
+    STATE_FAILED,
+  };
+
+  // Consumes header/trailer bytes; false on a format error
+  bool header_byte_(uint8_t c);
+  bool trailer_byte_(uint8_t c);
+  // Runs the deflate data of the chunk through the backend; advances data
+  // and len past what it consumed
+  bool inflate_(const uint8_t *&data, size_t &len, const Sink &sink);
+  // Next header state after the fixed part and each optional field
+  void next_field_();
+  bool fail_();
+
+  void *backend_{nullptr};
+  bool psram_{false};
+  State state_{STATE_FAILED};
+  uint8_t flags_{0};
+  uint16_t count_{0};  // bytes into the current header field / trailer
+  uint16_t extra_len_{0};
+  uint32_t size_{0};  // ISIZE from the trailer
+  uint32_t decoded_{0};
+  uint32_t window_pos_{0};
+};
+
+}  // namespace weather_bom
+}  // namespace esphome
+
+#endif  // WEATHER_BOM_GZIP
@@ -0,0 +1,39 @@
+#include "hourly_ring.h"
+
+namespace esphome {
+namespace weather_bom {
+
+static constexpr time_t HOUR_S = 3600;
+
+void HourlyRing::push(const HourlyData& hour) {
+  if (this->count_ == CAPACITY) {
+    this->head_ = (this->head_ + 1) % CAPACITY;
+    this->count_--;
+  }
+  this->hours_[(this->head_ + this->count_) % CAPACITY] = hour;
+  this->count_++;
+}
+
+void HourlyRing::drop_before(time_t now) {
+  while (this->count_ > 0 &&
+         (time_t)this->hours_[this->head_].time + HOUR_S <= now) {
+    this->head_ = (this->head_ + 1) % CAPACITY;
+    this->count_--;
+  }
+}
+
+const HourlyData* HourlyRing::get(uint8_t i) const {
+  if (i >= this->count_) return nullptr;
+  return &this->hours_[(this->head_ + i) % CAPACITY];
+}
+
+const HourlyData* HourlyRing::at(time_t when) const {
+  for (uint8_t i = 0; i < this->count_; i++) {
+    const HourlyData* h = this->get(i);
+    if ((time_t)h->time <= when && when < (time_t)h->time + HOUR_S) return h;
+  }
+  return nullptr;
+}
+
+}  // namespace weather_bom
+}  // namespace esphome
@@ -0,0 +1,44 @@
+#pragma once
+#include <climits>
+#include <cstdint>
+#include <ctime>
+
+namespace esphome {
+namespace weather_bom {
+
+// One hour of /forecasts/hourly, packed into 8 bytes
+struct HourlyData {
+  static constexpr int16_t NO_TEMP = INT16_MIN;
+  static constexpr uint8_t NO_VALUE = 0xFF;
+  uint32_t time;        // epoch seconds at the start of the hour
+  int16_t temp;         // 0.1 °C
+  uint8_t rain_chance;  // %
+  uint8_t wind_kmh;     // saturates at 254
+};
+
+// Consecutive forecast hours, oldest first, in a fixed-size ring. Plain data,
+// so it can be copied between result buffers and kept in the flash snapshot;
+// hours that have passed are dropped from the front without moving the rest.
+class HourlyRing {
+ public:
+  static constexpr uint8_t CAPACITY = 48;
+
+  void clear() { this->head_ = this->count_ = 0; }
+  uint8_t size() const { return this->count_; }
+  // Appends a later hour; the oldest is overwritten once full
+  void push(const HourlyData &hour);
+  // Drops hours that ended at or before now
+  void drop_before(time_t now);
+  // i-th held hour, oldest first; nullptr past the end
+  const HourlyData *get(uint8_t i) const;
+  // The held hour containing when, or nullptr
+  const HourlyData *at(time_t when) const;
+
+ protected:
+  HourlyData hours_[CAPACITY];
+  uint8_t head_{0};
+  uint8_t count_{0};
+};
+
+}  // namespace weather_bom
+}  // namespace esphome
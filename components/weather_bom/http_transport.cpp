@@ -0,0 +1,68 @@
+#include "http_transport.h"
+
+#include <strings.h>
+
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace weather_bom {
+
+static const char* const TAG = "weather_bom.http";
+
+#ifdef WEATHER_BOM_GZIP
+bool HttpTransport::enable_gzip() {
+  auto gzip = std::make_unique<GzipStream>();
+  if (!gzip->init()) return false;
+  this->gzip_ = std::move(gzip);
+  return true;
+}
+#endif
+
+void HttpTransport::begin_body_() {
+  this->stopped_ = false;
+  this->timing_.decoded_bytes = 0;
+#ifdef WEATHER_BOM_GZIP
+  this->gzip_body_ = false;
+#endif
+}
+
+void HttpTransport::content_encoding_(const char* value) {
+#ifdef WEATHER_BOM_GZIP
+  if (this->gzip_ && strcasecmp(value, "gzip") == 0) {
+    this->gzip_body_ = true;
+    this->gzip_->begin();
+    return;
+  }
+#endif
+  if (strcasecmp(value, "identity") != 0)
+    ESP_LOGW(TAG, "Unsupported Content-Encoding: %s", value);
+}
+
+void HttpTransport::deliver_(const DataCallback& on_data, const char* data,
+                             size_t len) {
+  if (this->stopped_) return;
+#ifdef WEATHER_BOM_GZIP
+  if (this->gzip_body_) {
+    this->stopped_ = !this->gzip_->feed(data, len, on_data);
+    this->timing_.decoded_bytes = this->gzip_->decoded();
+    if (this->gzip_->failed())
+      ESP_LOGW(TAG, "Malformed gzip body after %u bytes",
+               (unsigned)this->timing_.decoded_bytes);
+    return;
+  }
+#endif
+  this->timing_.decoded_bytes += len;
+  this->stopped_ = !on_data(data, len);
+}
+
+// A gzip body has to run to its trailer unless on_data itself stopped it
+bool HttpTransport::body_complete_() const {
+#ifdef WEATHER_BOM_GZIP
+  if (this->gzip_body_)
+    return this->gzip_->done() || (this->stopped_ && !this->gzip_->failed());
+#endif
+  return true;
+}
+
+}  // namespace weather_bom
+}  // namespace esphome
@@ -0,0 +1,98 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "gzip_stream.h"
+
+namespace esphome {
+namespace weather_bom {
+
+// Cache validators for a conditional GET (If-None-Match / If-Modified-Since)
+struct HttpValidators {
+  std::string etag;
+  std::string last_modified;
+
+  bool empty() const { return etag.empty() && last_modified.empty(); }
+};
+
+// Where the time of the last get() went, in microseconds
+struct HttpTiming {
+  uint32_t connect_us{0};   // DNS + TCP + TLS; 0 on a reused connection
+  uint32_t ttfb_us{0};      // connected (or request start) to response headers
+  uint32_t download_us{0};  // response headers to end of body
+  uint32_t body_bytes{0};     // as received, i.e. compressed when gzip
+  uint32_t decoded_bytes{0};  // as handed to on_data
+};
+
+// What fetch_url_ needs from an HTTP stack: a GET whose body is handed over
+// chunk by chunk as it arrives. Implementations keep their connection open
+// between calls where the protocol allows it, and pass body chunks through
+// deliver_() so a gzip Content-Encoding is undone before on_data sees them.
+class HttpTransport {
+ public:
+  // Returns false to stop delivery; the transport still drains the body so
+  // the connection can be reused.
+  using DataCallback = std::function<bool(const char *data, size_t len)>;
+
+  virtual ~HttpTransport() = default;
+
+  // Performs a GET. on_data only sees the body of a 200 response, decoded.
+  // Returns the HTTP status code, or -1 if no response was received or its
+  // gzip body was malformed or cut short.
+  //
+  // With validators set, their values are sent as conditional headers (a 304
+  // means the cached copy is current) and replaced by those of a 200.
+  virtual int get(const std::string &url, const DataCallback &on_data,
+                  HttpValidators *validators = nullptr) = 0;
+
+  // Drops the open connection (end of a fetch cycle).
+  virtual void close() {}
+
+  // Ahead of the first request, from the fetch task: prepare() sets up what
+  // needs no network (TLS context, client state); resolve() looks up url's
+  // host, so the first connection finds it in the resolver's cache, and
+  // returns whether it did.
+  virtual void prepare() {}
+  virtual bool resolve(const std::string & /*url*/) { return false; }
+
+#ifdef WEATHER_BOM_GZIP
+  // Sends Accept-Encoding: gzip from now on. Takes the inflater's window, so
+  // call it at setup; false (and plain bodies) if there is no memory for it.
+  bool enable_gzip();
+  bool gzip_enabled() const { return this->gzip_ != nullptr; }
+#endif
+
+  // Requests that got an HTTP status, and of those the ones answered on a
+  // connection already open when they were sent (no TCP or TLS handshake)
+  uint32_t responses() const { return this->responses_; }
+  uint32_t reused() const { return this->reused_; }
+  // New connections that offered a saved TLS session; whether the server
+  // took it is not known
+  uint32_t sessions_offered() const { return this->sessions_offered_; }
+  const HttpTiming &last_timing() const { return this->timing_; }
+
+ protected:
+  // For implementations, per response: begin_body_() before it is read,
+  // content_encoding_() with that header, deliver_() for each chunk of a 200
+  // body and body_complete_() once the body has been read
+  void begin_body_();
+  void content_encoding_(const char *value);
+  void deliver_(const DataCallback &on_data, const char *data, size_t len);
+  bool body_complete_() const;
+
+  uint32_t responses_{0};
+  uint32_t reused_{0};
+  uint32_t sessions_offered_{0};
+  HttpTiming timing_;
+  bool stopped_{false};  // on_data returned false, or the body did not decode
+#ifdef WEATHER_BOM_GZIP
+  std::unique_ptr<GzipStream> gzip_;
+  bool gzip_body_{false};  // this response is gzip encoded
+#endif
+};
+
+}  // namespace weather_bom
+}  // namespace esphome
@@ -0,0 +1,444 @@
+#include "json_stream.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace esphome {
+namespace weather_bom {
+
+bool JsonPath::matches(const char* pattern) const {
+  uint8_t i = 0;
+  const char* p = pattern;
+  while (*p) {
+    if (i >= this->depth_ || i >= MAX_DEPTH) return false;
+    const char* slash = strchr(p, '/');
+    size_t n = slash ? (size_t)(slash - p) : strlen(p);
+
+    if (n == 1 && *p == '*') {
+      // any segment
+    } else if (n == 1 && *p == '#') {
+      if (!this->is_index(i)) return false;
+    } else if (*p >= '0' && *p <= '9') {
+      if (!this->is_index(i) || this->segs_[i].index != atoi(p)) return false;
+    } else {
+      if (this->is_index(i)) return false;
+      const char* k = this->segs_[i].key;
+      if (strncmp(k, p, n) != 0 || k[n] != '\0') return false;
+    }
+
+    i++;
+    p += n;
+    if (*p == '/') p++;
+  }
+  return i == this->depth_;
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+bool JsonStreamParser::feed(const char* data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    if (this->state_ == State::ERROR) return false;
+    this->consume_(data[i]);
+    this->consumed_++;
+  }
+  return this->state_ != State::ERROR;
+}
+
+bool JsonStreamParser::finish() {
+  if (this->state_ == State::NUMBER) {
+    if (!this->number_complete_()) {
+      this->state_ = State::ERROR;
+      return false;
+    }
+    this->end_scalar_(JsonType::NUMBER);
+  } else if (this->state_ == State::LITERAL) {
+    this->consume_(' ');  // terminate the literal
+  }
+  return this->state_ == State::DONE;
+}
+
+void JsonStreamParser::consume_(char c) {
+  // Multi-character tokens first; a number or literal ends on the first
+  // character that cannot belong to it, which is then handled below.
+  switch (this->state_) {
+    case State::STRING:
+    case State::KEY:
+      if (!this->string_char_(c)) this->state_ = State::ERROR;
+      return;
+    case State::NUMBER:
+      if (this->number_char_(c)) {
+        this->append_(c);
+        return;
+      }
+      // Anything else ends the number, which must be whole by then
+      if (!this->number_complete_()) {
+        this->state_ = State::ERROR;
+        return;
+      }
+      this->end_scalar_(JsonType::NUMBER);
+      break;
+    case State::LITERAL:
+      if (c >= 'a' && c <= 'z') {
+        this->append_(c);
+        return;
+      }
+      this->tok_[this->tok_len_] = '\0';
+      if (strcmp(this->tok_, "true") == 0 || strcmp(this->tok_, "false") == 0) {
+        this->end_scalar_(JsonType::BOOL);
+      } else if (strcmp(this->tok_, "null") == 0) {
+        this->end_scalar_(JsonType::NUL);
+      } else {
+        this->state_ = State::ERROR;
+        return;
+      }
+      break;
+    default:
+      break;
+  }
+
+  if (c == ' ' || c == '\t' || c == '\n' || c == '\r') return;
+
+  switch (this->state_) {
+    case State::VALUE:
+      if (!this->begin_value_(c)) this->state_ = State::ERROR;
+      return;
+    case State::ARRAY_FIRST:
+      if (c == ']') {
+        this->pop_();
+      } else if (!this->begin_value_(c)) {
+        this->state_ = State::ERROR;
+      }
+      return;
+    case State::OBJECT_FIRST:
+      if (c == '}') {
+        this->pop_();
+        return;
+      }
+      // fall through
+    case State::OBJECT_KEY:
+      if (c == '"') {
+        this->begin_string_(State::KEY);
+      } else {
+        this->state_ = State::ERROR;
+      }
+      return;
+    case State::COLON:
+      this->state_ = (c == ':') ? State::VALUE : State::ERROR;
+      return;
+    case State::AFTER_VALUE:
+      if (c == ',') {
+        this->state_ = this->top_is_array_() ? State::VALUE : State::OBJECT_KEY;
+      } else if ((c == ']' && this->top_is_array_()) ||
+                 (c == '}' && !this->top_is_array_())) {
+        this->pop_();
+      } else {
+        this->state_ = State::ERROR;
+      }
+      return;
+    default:
+      // Trailing garbage after the document, or already failed
+      this->state_ = State::ERROR;
+      return;
+  }
+}
+
+bool JsonStreamParser::begin_value_(char c) {
+  if (this->nest_ > 0 && this->nest_ <= JsonPath::MAX_DEPTH &&
+      this->top_is_array_())
+    this->path_.segs_[this->nest_ - 1].index++;
+
+  this->tok_len_ = 0;
+  switch (c) {
+    case '{':
+      this->handler_->on_container_start(this->path_, false);
+      this->push_(false);
+      if (this->state_ != State::ERROR) this->state_ = State::OBJECT_FIRST;
+      return true;
+    case '[':
+      this->handler_->on_container_start(this->path_, true);
+      this->push_(true);
+      if (this->state_ != State::ERROR) this->state_ = State::ARRAY_FIRST;
+      return true;
+    case '"':
+      this->begin_string_(State::STRING);
+      return true;
+    case 't':
+    case 'f':
+    case 'n':
+      this->append_(c);
+      this->state_ = State::LITERAL;
+      return true;
+    default:
+      if (c == '-' || (c >= '0' && c <= '9')) {
+        this->append_(c);
+        this->num_ = c == '-' ? NumPart::SIGN
+                     : c == '0' ? NumPart::ZERO
+                                : NumPart::INT;
+        this->state_ = State::NUMBER;
+        return true;
+      }
+      return false;
+  }
+}
+
+// Advances num_ if c continues the number; false if it cannot
+bool JsonStreamParser::number_char_(char c) {
+  const bool digit = c >= '0' && c <= '9';
+  switch (this->num_) {
+    case NumPart::SIGN:
+      if (!digit) return false;
+      this->num_ = c == '0' ? NumPart::ZERO : NumPart::INT;
+      return true;
+    case NumPart::ZERO:
+    case NumPart::INT:
+      if (digit && this->num_ == NumPart::INT) return true;
+      if (c == '.') {
+        this->num_ = NumPart::POINT;
+        return true;
+      }
+      break;
+    case NumPart::POINT:
+    case NumPart::FRAC:
+      if (digit) {
+        this->num_ = NumPart::FRAC;
+        return true;
+      }
+      if (this->num_ == NumPart::POINT) return false;
+      break;
+    case NumPart::EXP:
+      if (c == '+' || c == '-') {
+        this->num_ = NumPart::EXP_SIGN;
+        return true;
+      }
+      // fall through
+    case NumPart::EXP_SIGN:
+    case NumPart::EXP_DIGITS:
+      if (!digit) return false;
+      this->num_ = NumPart::EXP_DIGITS;
+      return true;
+  }
+  if (c == 'e' || c == 'E') {
+    this->num_ = NumPart::EXP;
+    return true;
+  }
+  return false;
+}
+
+bool JsonStreamParser::number_complete_() const {
+  return this->num_ == NumPart::ZERO || this->num_ == NumPart::INT ||
+         this->num_ == NumPart::FRAC || this->num_ == NumPart::EXP_DIGITS;
+}
+
+void JsonStreamParser::push_(bool is_array) {
+  if (this->nest_ >= MAX_NESTING) {
+    this->state_ = State::ERROR;
+    return;
+  }
+  if (this->nest_ < JsonPath::MAX_DEPTH) {
+    this->path_.segs_[this->nest_].index = -1;
+    this->path_.segs_[this->nest_].key[0] = '\0';
+  }
+  if (is_array) {
+    this->array_bits_ |= (1u << this->nest_);
+  } else {
+    this->array_bits_ &= ~(1u << this->nest_);
+  }
+  this->nest_++;
+  this->path_.array_bits_ = this->array_bits_;
+  this->path_.depth_ = this->nest_;
+}
+
+void JsonStreamParser::pop_() {
+  bool is_array = this->top_is_array_();
+  this->nest_--;
+  this->path_.depth_ = this->nest_;
+  this->handler_->on_container_end(this->path_, is_array);
+  this->state_ = this->nest_ == 0 ? State::DONE : State::AFTER_VALUE;
+}
+
+void JsonStreamParser::append_(char c) {
+  if (this->tok_len_ < MAX_TOKEN - 1) this->tok_[this->tok_len_++] = c;
+}
+
+void JsonStreamParser::append_utf8_(uint32_t cp) {
+  // Never emit a partial sequence when the token buffer is nearly full
+  size_t need = cp < 0x80 ? 1 : cp < 0x800 ? 2 : cp < 0x10000 ? 3 : 4;
+  if (this->tok_len_ + need > MAX_TOKEN - 1) {
+    this->tok_len_ = MAX_TOKEN - 1;
+    return;
+  }
+  if (need == 1) {
+    this->append_((char)cp);
+  } else if (need == 2) {
+    this->append_((char)(0xC0 | (cp >> 6)));
+    this->append_((char)(0x80 | (cp & 0x3F)));
+  } else if (need == 3) {
+    this->append_((char)(0xE0 | (cp >> 12)));
+    this->append_((char)(0x80 | ((cp >> 6) & 0x3F)));
+    this->append_((char)(0x80 | (cp & 0x3F)));
+  } else {
+    this->append_((char)(0xF0 | (cp >> 18)));
+    this->append_((char)(0x80 | ((cp >> 12) & 0x3F)));
+    this->append_((char)(0x80 | ((cp >> 6) & 0x3F)));
+    this->append_((char)(0x80 | (cp & 0x3F)));
+  }
+}
+
+void JsonStreamParser::begin_string_(State state) {
+  this->tok_len_ = 0;
+  this->escape_ = false;
+  this->hex_left_ = 0;
+  this->high_surrogate_ = 0;
+  this->state_ = state;
+}
+
+// A high surrogate not followed by a \u low one stands for U+FFFD
+void JsonStreamParser::flush_surrogate_() {
+  if (this->high_surrogate_ == 0) return;
+  this->high_surrogate_ = 0;
+  this->append_utf8_(0xFFFD);
+}
+
+bool JsonStreamParser::string_char_(char c) {
+  if (this->hex_left_ > 0) {
+    int v = hex_value(c);
+    if (v < 0) return false;
+    this->hex_val_ = (this->hex_val_ << 4) | (uint32_t)v;
+    if (--this->hex_left_ > 0) return true;
+
+    uint32_t cp = this->hex_val_;
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+      this->high_surrogate_ = cp;
+      return true;
+    }
+    if (cp >= 0xDC00 && cp <= 0xDFFF) {
+      cp = this->high_surrogate_
+               ? 0x10000 + ((this->high_surrogate_ - 0xD800) << 10) +
+                     (cp - 0xDC00)
+               : 0xFFFD;
+    } else if (this->high_surrogate_) {
+      this->append_utf8_(0xFFFD);
+    }
+    this->high_surrogate_ = 0;
+    this->append_utf8_(cp);
+    return true;
+  }
+
+  if (this->escape_) {
+    this->escape_ = false;
+    if (c != 'u') this->flush_surrogate_();
+    switch (c) {
+      case '"':
+      case '\\':
+      case '/':
+        this->append_(c);
+        return true;
+      case 'b':
+        this->append_('\b');
+        return true;
+      case 'f':
+        this->append_('\f');
+        return true;
+      case 'n':
+        this->append_('\n');
+        return true;
+      case 'r':
+        this->append_('\r');
+        return true;
+      case 't':
+        this->append_('\t');
+        return true;
+      case 'u':
+        this->hex_left_ = 4;
+        this->hex_val_ = 0;
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  if (c == '\\') {
+    this->escape_ = true;
+    return true;
+  }
+  this->flush_surrogate_();
+  if (c == '"') {
+    if (this->state_ == State::KEY) {
+      this->end_key_();
+    } else {
+      this->end_scalar_(JsonType::STRING);
+    }
+    return true;
+  }
+  if ((unsigned char)c < 0x20) return false;
+
+  this->append_(c);
+  return true;
+}
+
+void JsonStreamParser::end_key_() {
+  this->tok_[this->tok_len_] = '\0';
+  if (this->nest_ <= JsonPath::MAX_DEPTH) {
+    char* key = this->path_.segs_[this->nest_ - 1].key;
+    strncpy(key, this->tok_, JsonPath::MAX_KEY - 1);
+    key[JsonPath::MAX_KEY - 1] = '\0';
+  }
+  this->state_ = State::COLON;
+}
+
+void JsonStreamParser::end_scalar_(JsonType type) {
+  // Drop a UTF-8 sequence cut short by truncation
+  if (this->tok_len_ == MAX_TOKEN - 1) {
+    size_t i = this->tok_len_;
+    while (i > 0 && ((unsigned char)this->tok_[i - 1] & 0xC0) == 0x80) i--;
+    if (i > 0 && ((unsigned char)this->tok_[i - 1] & 0x80)) {
+      unsigned char lead = (unsigned char)this->tok_[i - 1];
+      size_t want = (lead & 0xE0) == 0xC0 ? 2 : (lead & 0xF0) == 0xE0 ? 3 : 4;
+      if (this->tok_len_ - (i - 1) < want) this->tok_len_ = i - 1;
+    }
+  }
+  this->tok_[this->tok_len_] = '\0';
+  this->handler_->on_value(this->path_, type, this->tok_, this->tok_len_);
+  this->state_ = this->nest_ == 0 ? State::DONE : State::AFTER_VALUE;
+}
+
+void json_copy_string(char* dst, size_t size, const char* src) {
+  if (size == 0) return;
+  size_t n = strlen(src);
+  if (n >= size) {
+    n = size - 1;
+    // Back up to the start of a UTF-8 sequence
+    while (n > 0 && ((unsigned char)src[n] & 0xC0) == 0x80) n--;
+  }
+  memcpy(dst, src, n);
+  dst[n] = '\0';
+}
+
+void json_append_quoted(std::string& out, const char* s) {
+  static const char HEX[] = "0123456789abcdef";
+  out += '"';
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += (char)c;
+    } else if (c == '\n') {
+      out += "\\n";
+    } else if (c < 0x20) {
+      out += "\\u00";
+      out += HEX[c >> 4];
+      out += HEX[c & 0xF];
+    } else {
+      out += (char)c;
+    }
+  }
+  out += '"';
+}
+
+}  // namespace weather_bom
+}  // namespace esphome
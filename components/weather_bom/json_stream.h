@@ -0,0 +1,140 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace esphome {
+namespace weather_bom {
+
+enum class JsonType : uint8_t { STRING, NUMBER, BOOL, NUL };
+
+// Location of the current token inside the document, e.g. data/0/rain/chance.
+// Only the first MAX_DEPTH levels are tracked; deeper values never match.
+class JsonPath {
+ public:
+  static constexpr uint8_t MAX_DEPTH = 8;
+  static constexpr uint8_t MAX_KEY = 32;
+
+  uint8_t depth() const { return this->depth_; }
+  bool is_index(uint8_t i) const { return (this->array_bits_ >> i) & 1u; }
+  int index(uint8_t i) const { return this->segs_[i].index; }
+  const char *key(uint8_t i) const { return this->segs_[i].key; }
+
+  // '/'-separated pattern; a number matches that array index, "#" any index
+  // and "*" any segment, e.g. "data/#/rain/chance".
+  bool matches(const char *pattern) const;
+
+ protected:
+  friend class JsonStreamParser;
+
+  struct Segment {
+    int16_t index;
+    char key[MAX_KEY];
+  };
+
+  Segment segs_[MAX_DEPTH];
+  uint32_t array_bits_{0};
+  uint8_t depth_{0};
+};
+
+// Receives parse events. Container events carry the path of the container
+// itself; value events carry the path of the scalar.
+class JsonHandler {
+ public:
+  virtual ~JsonHandler() = default;
+  virtual void on_container_start(const JsonPath & /*path*/,
+                                  bool /*is_array*/) {}
+  virtual void on_container_end(const JsonPath & /*path*/,
+                                bool /*is_array*/) {}
+  virtual void on_value(const JsonPath &path, JsonType type, const char *value,
+                        size_t len) = 0;
+};
+
+// Incremental (SAX-style) JSON reader. Bytes may be pushed in chunks of any
+// size; memory use is fixed regardless of document size. Strings longer than
+// MAX_TOKEN are truncated (still NUL-terminated).
+class JsonStreamParser {
+ public:
+  static constexpr size_t MAX_TOKEN = 256;
+  static constexpr uint8_t MAX_NESTING = 32;
+
+  explicit JsonStreamParser(JsonHandler *handler) : handler_(handler) {}
+
+  // Returns false once the input is known to be malformed.
+  bool feed(const char *data, size_t len);
+  // Returns true if exactly one complete JSON value was read.
+  bool finish();
+
+  bool failed() const { return this->state_ == State::ERROR; }
+  size_t bytes_consumed() const { return this->consumed_; }
+
+ protected:
+  // Where a number token is in -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+  enum class NumPart : uint8_t {
+    SIGN,       // "-", a digit must follow
+    ZERO,       // a leading "0", which takes no further digit
+    INT,
+    POINT,      // ".", a digit must follow
+    FRAC,
+    EXP,        // "e", a sign or digit must follow
+    EXP_SIGN,   // a digit must follow
+    EXP_DIGITS,
+  };
+
+  enum class State : uint8_t {
+    VALUE,
+    ARRAY_FIRST,
+    OBJECT_FIRST,
+    OBJECT_KEY,
+    KEY,
+    COLON,
+    STRING,
+    NUMBER,
+    LITERAL,
+    AFTER_VALUE,
+    DONE,
+    ERROR,
+  };
+
+  void consume_(char c);
+  bool begin_value_(char c);
+  bool number_char_(char c);
+  bool number_complete_() const;
+  void push_(bool is_array);
+  void pop_();
+  void append_(char c);
+  void append_utf8_(uint32_t cp);
+  bool string_char_(char c);
+  void begin_string_(State state);
+  void flush_surrogate_();
+  void end_scalar_(JsonType type);
+  void end_key_();
+  bool top_is_array_() const { return (this->array_bits_ >> (this->nest_ - 1)) & 1u; }
+
+  JsonHandler *handler_;
+  JsonPath path_;
+  State state_{State::VALUE};
+  uint8_t nest_{0};
+  uint32_t array_bits_{0};
+  NumPart num_{NumPart::INT};
+
+  char tok_[MAX_TOKEN];
+  size_t tok_len_{0};
+  size_t consumed_{0};
+
+  // String escape handling
+  bool escape_{false};
+  uint8_t hex_left_{0};
+  uint32_t hex_val_{0};
+  uint32_t high_surrogate_{0};
+};
+
+// Copies src into dst (always NUL-terminated) without splitting a UTF-8
+// sequence when it has to be truncated.
+void json_copy_string(char *dst, size_t size, const char *src);
+
+// Appends s to out as a quoted JSON string.
+void json_append_quoted(std::string &out, const char *s);
+
+}  // namespace weather_bom
+}  // namespace esphome
@@ -0,0 +1,61 @@
+#include "location_cache.h"
+
+#include <cstring>
+
+#include "esphome/core/helpers.h"
+#include "esphome/core/log.h"
+#include "json_stream.h"
+
+namespace esphome {
+namespace weather_bom {
+
+static const char* const TAG = "weather_bom.locations";
+
+void LocationCache::load() {
+  // Bump the suffix when Stored changes layout
+  this->pref_ = global_preferences->make_preference<Stored>(
+      fnv1_hash("weather_bom_locations_v1"), true);
+  if (!this->pref_.load(&this->data_)) {
+    this->data_ = Stored{};
+    return;
+  }
+  if (this->data_.next >= SIZE) this->data_.next = 0;
+  for (auto& e : this->data_.entries) {
+    // Guard against a torn or foreign record
+    e.cell[sizeof(e.cell) - 1] = '\0';
+    e.geohash[sizeof(e.geohash) - 1] = '\0';
+    e.name[sizeof(e.name) - 1] = '\0';
+    if (e.cell[0])
+      ESP_LOGD(TAG, "Cached cell %s -> %s (%s)", e.cell, e.geohash, e.name);
+  }
+}
+
+const LocationCache::Entry* LocationCache::find(const char* cell) const {
+  for (const auto& e : this->data_.entries) {
+    if (e.cell[0] && strcmp(e.cell, cell) == 0) return &e;
+  }
+  return nullptr;
+}
+
+void LocationCache::put(const char* cell, const char* geohash,
+                        const char* name) {
+  Entry* slot = const_cast<Entry*>(this->find(cell));
+  if (slot == nullptr) {
+    slot = &this->data_.entries[this->data_.next];
+    this->data_.next = (this->data_.next + 1) % SIZE;
+  }
+  json_copy_string(slot->cell, sizeof(slot->cell), cell);
+  json_copy_string(slot->geohash, sizeof(slot->geohash), geohash);
+  json_copy_string(slot->name, sizeof(slot->name), name);
+  this->dirty_ = true;
+}
+
+void LocationCache::save_if_dirty() {
+  if (!this->dirty_) return;
+  this->dirty_ = false;
+  if (!this->pref_.save(&this->data_))
+    ESP_LOGW(TAG, "Failed to save location cache");
+}
+
+}  // namespace weather_bom
+}  // namespace esphome
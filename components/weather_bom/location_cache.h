@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+
+#include "esphome/core/preferences.h"
+
+namespace esphome {
+namespace weather_bom {
+
+// Small round-robin table in flash preferences mapping a locally encoded
+// geohash cell to the BOM geohash and location name that /locations?search
+// returned for it, so a known cell needs no search after a reboot.
+//
+// load() and save_if_dirty() touch preferences and must run on the main
+// loop; find()/put() only touch RAM.
+class LocationCache {
+ public:
+  static constexpr uint8_t SIZE = 8;
+
+  struct Entry {
+    char cell[8];
+    char geohash[8];
+    char name[48];
+  };
+
+  void load();
+  const Entry *find(const char *cell) const;
+  void put(const char *cell, const char *geohash, const char *name);
+  void save_if_dirty();
+
+ protected:
+  struct Stored {
+    uint8_t next;  // slot to overwrite next
+    Entry entries[SIZE];
+  };
+
+  Stored data_{};
+  ESPPreferenceObject pref_;
+  bool dirty_{false};
+};
+
+}  // namespace weather_bom
+}  // namespace esphome
@@ -0,0 +1,217 @@
+#include "observation_history.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace esphome {
+namespace weather_bom {
+
+static constexpr uint32_t DUMP_MAGIC = 0x484f4257;  // "WBOH" in memory order
+static constexpr uint32_t TREND_S = 3 * 3600;
+static constexpr uint32_t RAIN_RATE_S = 3600;
+
+static ObservationSample pack(const ObservationData& obs) {
+  ObservationSample s;
+  if (!std::isnan(obs.temp)) s.temp = (int16_t)lroundf(obs.temp * 10);
+  if (!std::isnan(obs.rain_since_9am))
+    s.rain = (uint16_t)std::min(std::max(lroundf(obs.rain_since_9am * 10), 0L),
+                                (long)ObservationSample::NO_RAIN - 1);
+  if (!std::isnan(obs.humidity))
+    s.humidity = (uint8_t)std::min(std::max(lroundf(obs.humidity), 0L), 100L);
+  if (!std::isnan(obs.wind_kmh))
+    s.wind_kmh = (uint8_t)std::min(std::max(lroundf(obs.wind_kmh), 0L), 254L);
+  return s;
+}
+
+static bool has_temp(const ObservationSample& s) {
+  return s.temp != ObservationSample::NO_TEMP;
+}
+static bool has_rain(const ObservationSample& s) {
+  return s.rain != ObservationSample::NO_RAIN;
+}
+
+void ObservationHistory::set_resolution(uint32_t seconds) {
+  *this = ObservationHistory{};
+  this->resolution_ = seconds > 0 ? seconds : 1;
+}
+
+void ObservationHistory::add(time_t when, const ObservationData& obs) {
+  if (when <= 0) return;
+  const uint32_t slot = (uint32_t)(when / this->resolution_);
+  if (this->latest_slot_ != 0 && slot != this->latest_slot_) {
+    if (slot < this->latest_slot_) return;
+    // Close the current slot; slots nothing was seen in stay empty
+    this->commit_(this->latest_);
+    const uint32_t gap = slot - this->latest_slot_ - 1;
+    for (uint32_t i = 0; i < gap && i < CAPACITY; i++)
+      this->commit_(ObservationSample{});
+  }
+  this->latest_ = pack(obs);
+  this->latest_slot_ = slot;
+}
+
+void ObservationHistory::commit_(const ObservationSample& s) {
+  if (this->count_ == CAPACITY) {
+    const ObservationSample& old = this->ring_[this->head_];
+    if (has_temp(old)) {
+      this->temp_sum_ -= old.temp;
+      this->temp_count_--;
+    }
+    // The oldest sample can only be at the front of either queue
+    for (ExtremeQueue* q : {&this->min_q_, &this->max_q_}) {
+      if (q->count > 0 && q->front() == this->head_) {
+        q->head = (q->head + 1) % CAPACITY;
+        q->count--;
+      }
+    }
+    this->head_ = (this->head_ + 1) % CAPACITY;
+    this->count_--;
+  }
+  const uint8_t pos = (this->head_ + this->count_) % CAPACITY;
+  this->ring_[pos] = s;
+  this->count_++;
+  if (has_temp(s)) {
+    this->temp_sum_ += s.temp;
+    this->temp_count_++;
+    this->push_extreme_(this->min_q_, pos, true);
+    this->push_extreme_(this->max_q_, pos, false);
+  }
+}
+
+// Samples behind pos that are no better can never be the extreme again
+void ObservationHistory::push_extreme_(ExtremeQueue& q, uint8_t pos,
+                                       bool is_min) {
+  const int16_t v = this->ring_[pos].temp;
+  while (q.count > 0) {
+    const int16_t b = this->ring_[q.back()].temp;
+    if (is_min ? b < v : b > v) break;
+    q.count--;
+  }
+  q.pos[(q.head + q.count) % CAPACITY] = pos;
+  q.count++;
+}
+
+uint16_t ObservationHistory::size() const {
+  return this->count_ + (this->latest_slot_ != 0 ? 1 : 0);
+}
+
+const ObservationSample* ObservationHistory::get(uint16_t i) const {
+  if (i < this->count_) return &this->ring_[(this->head_ + i) % CAPACITY];
+  if (i == this->count_ && this->latest_slot_ != 0) return &this->latest_;
+  return nullptr;
+}
+
+time_t ObservationHistory::latest_time() const {
+  return (time_t)this->latest_slot_ * this->resolution_;
+}
+
+float ObservationHistory::temp_min() const {
+  int32_t v = INT32_MAX;
+  if (this->min_q_.count > 0) v = this->ring_[this->min_q_.front()].temp;
+  if (has_temp(this->latest_) && this->latest_.temp < v) v = this->latest_.temp;
+  return v == INT32_MAX ? NAN : v / 10.0f;
+}
+
+float ObservationHistory::temp_max() const {
+  int32_t v = INT32_MIN;
+  if (this->max_q_.count > 0) v = this->ring_[this->max_q_.front()].temp;
+  if (has_temp(this->latest_) && this->latest_.temp > v) v = this->latest_.temp;
+  return v == INT32_MIN ? NAN : v / 10.0f;
+}
+
+float ObservationHistory::temp_mean() const {
+  int32_t sum = this->temp_sum_;
+  uint32_t n = this->temp_count_;
+  if (has_temp(this->latest_)) {
+    sum += this->latest_.temp;
+    n++;
+  }
+  return n == 0 ? NAN : sum / (10.0f * n);
+}
+
+const ObservationSample* ObservationHistory::back_(
+    uint32_t& slots_back, bool (*has)(const ObservationSample&)) const {
+  const uint16_t n = this->size();
+  // The slot itself, then one further back, then one nearer
+  for (int32_t d : {0, 1, -1}) {
+    const int64_t back = (int64_t)slots_back + d;
+    if (back <= 0 || back >= n) continue;
+    const ObservationSample* s = this->get(n - 1 - back);
+    if (has(*s)) {
+      slots_back = (uint32_t)back;
+      return s;
+    }
+  }
+  return nullptr;
+}
+
+float ObservationHistory::temp_trend() const {
+  if (this->latest_slot_ == 0 || !has_temp(this->latest_)) return NAN;
+  uint32_t back = std::max<uint32_t>(
+      (TREND_S + this->resolution_ / 2) / this->resolution_, 1);
+  const ObservationSample* then = this->back_(back, has_temp);
+  if (then == nullptr) return NAN;
+  return (this->latest_.temp - then->temp) / 10.0f * TREND_S /
+         (back * this->resolution_);
+}
+
+float ObservationHistory::rain_rate() const {
+  if (this->latest_slot_ == 0 || !has_rain(this->latest_)) return NAN;
+  uint32_t back = std::max<uint32_t>(
+      (RAIN_RATE_S + this->resolution_ / 2) / this->resolution_, 1);
+  const ObservationSample* then = this->back_(back, has_rain);
+  if (then == nullptr) return NAN;
+  const uint16_t now = this->latest_.rain;
+  const uint16_t rain = now >= then->rain ? now - then->rain : now;
+  return rain / 10.0f * RAIN_RATE_S / (back * this->resolution_);
+}
+
+// Native byte order, like the snapshot blob: magic, resolution (s, 16 bits),
+// sample count (16 bits), start of the newest slot (epoch, 32 bits)
+size_t ObservationHistory::dump(uint8_t* out, size_t len,
+                                uint16_t newest) const {
+  const uint16_t n = std::min(this->size(), newest);
+  const uint16_t first = this->size() - n;
+  const size_t total = DUMP_HEADER + n * sizeof(ObservationSample);
+  if (len < total) return 0;
+  const uint16_t resolution = (uint16_t)this->resolution_;
+  const uint32_t latest = (uint32_t)this->latest_time();
+  memcpy(out, &DUMP_MAGIC, 4);
+  memcpy(out + 4, &resolution, 2);
+  memcpy(out + 6, &n, 2);
+  memcpy(out + 8, &latest, 4);
+  uint8_t* p = out + DUMP_HEADER;
+  for (uint16_t i = 0; i < n; i++, p += sizeof(ObservationSample))
+    memcpy(p, this->get(first + i), sizeof(ObservationSample));
+  return total;
+}
+
+// The aggregates are rebuilt by committing the samples again
+bool ObservationHistory::load(const uint8_t* in, size_t len) {
+  if (len < DUMP_HEADER) return false;
+  uint32_t magic, latest;
+  uint16_t resolution, n;
+  memcpy(&magic, in, 4);
+  memcpy(&resolution, in + 4, 2);
+  memcpy(&n, in + 6, 2);
+  memcpy(&latest, in + 8, 4);
+  if (magic != DUMP_MAGIC || resolution != this->resolution_ ||
+      n > CAPACITY + 1 || len < DUMP_HEADER + n * sizeof(ObservationSample) ||
+      (n > 0 && latest < resolution))
+    return false;
+  this->set_resolution(resolution);
+  if (n == 0) return true;
+  const uint8_t* p = in + DUMP_HEADER;
+  ObservationSample s;
+  for (uint16_t i = 0; i + 1 < n; i++, p += sizeof(ObservationSample)) {
+    memcpy(&s, p, sizeof(ObservationSample));
+    this->commit_(s);
+  }
+  memcpy(&this->latest_, p, sizeof(ObservationSample));
+  this->latest_slot_ = latest / resolution;
+  return true;
+}
+
+}  // namespace weather_bom
+}  // namespace esphome
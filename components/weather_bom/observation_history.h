@@ -0,0 +1,114 @@
+#pragma once
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+namespace esphome {
+namespace weather_bom {
+
+// Fields extracted from /observations
+struct ObservationData {
+  float temp{NAN};
+  float humidity{NAN};
+  float wind_kmh{NAN};
+  float rain_since_9am{NAN};
+};
+
+// One slot of observation history, packed into 6 bytes
+struct ObservationSample {
+  static constexpr int16_t NO_TEMP = INT16_MIN;
+  static constexpr uint16_t NO_RAIN = 0xFFFF;
+  static constexpr uint8_t NO_VALUE = 0xFF;
+  int16_t temp{NO_TEMP};      // 0.1 °C
+  uint16_t rain{NO_RAIN};     // 0.1 mm since 9 am
+  uint8_t humidity{NO_VALUE};  // %
+  uint8_t wind_kmh{NO_VALUE};  // saturates at 254
+
+  bool empty() const { return this->temp == NO_TEMP && this->rain == NO_RAIN; }
+};
+
+// Observations over the last CAPACITY slots of a fixed resolution (24 h at
+// the default 10 minutes), oldest first in a ring. A slot holds the last
+// observation seen in it; slots with none stay empty. The slot being filled
+// is kept apart and only enters the ring once a later slot starts, so
+// everything in the ring is final.
+//
+// Aggregates are kept as samples come and go: a running sum for the mean,
+// and monotonic queues of ring positions for the minimum and maximum, so
+// every query is O(1) and each sample is pushed and popped at most once.
+class ObservationHistory {
+ public:
+  static constexpr uint8_t CAPACITY = 144;
+
+  // Seconds per slot, at most an hour; clears the history
+  void set_resolution(uint32_t seconds);
+  uint32_t resolution() const { return this->resolution_; }
+
+  // Records obs as seen at when (epoch seconds). A later slot closes the
+  // current one; an earlier one (the clock went back) is ignored.
+  void add(time_t when, const ObservationData &obs);
+
+  // Slots held, the current one included, gaps counted
+  uint16_t size() const;
+  // i-th slot, oldest first, the current one last; nullptr past the end
+  const ObservationSample *get(uint16_t i) const;
+  // Start (epoch seconds) of the current slot, 0 before the first sample
+  time_t latest_time() const;
+
+  // Over everything held; NAN without a temperature
+  float temp_min() const;
+  float temp_max() const;
+  float temp_mean() const;
+  // °C per 3 h, from the current slot and the one 3 h before it
+  float temp_trend() const;
+  // mm/h over the last hour, from rain since 9 am; across the 9 am reset,
+  // the rain since the reset
+  float rain_rate() const;
+
+  // Header then the newest samples (all by default), oldest first; 0 if out
+  // is too small
+  static constexpr size_t DUMP_HEADER = 12;
+  static constexpr size_t DUMP_MAX =
+      DUMP_HEADER + (CAPACITY + 1) * sizeof(ObservationSample);
+  size_t dump(uint8_t *out, size_t len, uint16_t newest = UINT16_MAX) const;
+  // Replaces the history with a dump of it; false, leaving it as it was, if
+  // in is not a whole dump at this resolution
+  bool load(const uint8_t *in, size_t len);
+
+ protected:
+  // Ring positions whose temperatures only rise (for the minimum) or only
+  // fall (for the maximum) from front to back
+  struct ExtremeQueue {
+    uint8_t pos[CAPACITY];
+    uint8_t head{0};
+    uint8_t count{0};
+
+    uint8_t front() const { return this->pos[this->head]; }
+    uint8_t back() const {
+      return this->pos[(this->head + this->count - 1) % CAPACITY];
+    }
+  };
+
+  void commit_(const ObservationSample &s);
+  void push_extreme_(ExtremeQueue &q, uint8_t pos, bool is_min);
+  // The sample about slots_back slots before the current one that has a
+  // value, or a neighbour that does; sets slots_back to where it was found
+  const ObservationSample *back_(uint32_t &slots_back,
+                                 bool (*has)(const ObservationSample &)) const;
+
+  uint32_t resolution_{600};
+  ObservationSample ring_[CAPACITY];
+  uint8_t head_{0};
+  uint8_t count_{0};
+  ObservationSample latest_;
+  uint32_t latest_slot_{0};  // epoch / resolution_, 0 before the first sample
+  int32_t temp_sum_{0};      // of the ring's temperatures
+  uint8_t temp_count_{0};
+  ExtremeQueue min_q_;
+  ExtremeQueue max_q_;
+};
+
+}  // namespace weather_bom
+}  // namespace esphome
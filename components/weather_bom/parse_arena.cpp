@@ -0,0 +1,46 @@
+#include "parse_arena.h"
+
+#include <cstdlib>
+
+#ifdef USE_ESP_IDF
+#include "esp_heap_caps.h"
+#endif
+
+namespace esphome {
+namespace weather_bom {
+
+bool ParseArena::init(size_t size) {
+#ifdef USE_ESP_IDF
+  this->base_ = static_cast<uint8_t*>(heap_caps_malloc(size, MALLOC_CAP_SPIRAM));
+  this->psram_ = this->base_ != nullptr;
+  if (this->base_ == nullptr)
+    this->base_ = static_cast<uint8_t*>(
+        heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+#else
+  this->base_ = static_cast<uint8_t*>(malloc(size));
+#endif
+  this->size_ = this->base_ != nullptr ? size : 0;
+  return this->base_ != nullptr;
+}
+
+void* ParseArena::allocate(size_t size, size_t align) {
+  if (this->base_ == nullptr) return nullptr;
+  size_t used = this->used_.load(std::memory_order_relaxed);
+  size_t start;
+  do {
+    start = (used + align - 1) & ~(align - 1);
+    if (start + size > this->size_) {
+      this->fallbacks_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+  } while (!this->used_.compare_exchange_weak(used, start + size,
+                                              std::memory_order_relaxed));
+  return this->base_ + start;
+}
+
+void ParseArena::reset() {
+  this->last_used_ = this->used_.exchange(0, std::memory_order_relaxed);
+}
+
+}  // namespace weather_bom
+}  // namespace esphome
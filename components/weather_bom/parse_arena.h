@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace esphome {
+namespace weather_bom {
+
+// Bump allocator for the parser state of a fetch cycle. The block is taken
+// once at boot (PSRAM when the board has it) and handed out front to back;
+// reset() at the end of the cycle frees everything in one step, so parsing
+// leaves no holes in the heap however long the device runs. Allocation is
+// lock-free, for concurrent fetches.
+class ParseArena {
+ public:
+  // false if no memory could be had; the arena then stays off
+  bool init(size_t size);
+  bool enabled() const { return this->base_ != nullptr; }
+  bool in_psram() const { return this->psram_; }
+  size_t size() const { return this->size_; }
+
+  // A T built in the arena, or nullptr when it is off or full (counted as a
+  // fallback). Never destroyed, hence trivially destructible types only.
+  template<typename T, typename... Args> T *make(Args &&...args) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "arena objects are never destroyed");
+    void *p = this->allocate(sizeof(T), alignof(T));
+    return p ? new (p) T(std::forward<Args>(args)...) : nullptr;
+  }
+  void *allocate(size_t size, size_t align);
+  // Start of a cycle's worth of allocations; keeps the previous peak
+  void reset();
+
+  // Bytes used by the last cycle, and allocations that did not fit since boot
+  size_t last_used() const { return this->last_used_; }
+  uint32_t fallbacks() const {
+    return this->fallbacks_.load(std::memory_order_relaxed);
+  }
+
+ protected:
+  uint8_t *base_{nullptr};
+  size_t size_{0};
+  bool psram_{false};
+  std::atomic<size_t> used_{0};
+  std::atomic<uint32_t> fallbacks_{0};
+  size_t last_used_{0};
+};
+
+}  // namespace weather_bom
+}  // namespace esphome
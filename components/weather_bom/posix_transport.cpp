@@ -0,0 +1,293 @@
+#ifdef USE_HOST
+
+#include "posix_transport.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace weather_bom {
+
+static const char* const TAG = "weather_bom.http";
+
+static std::string to_lower(std::string s) {
+  for (auto& c : s) c = (char)tolower((unsigned char)c);
+  return s;
+}
+
+static std::string trim(const std::string& s) {
+  size_t b = s.find_first_not_of(" \t");
+  if (b == std::string::npos) return {};
+  size_t e = s.find_last_not_of(" \t");
+  return s.substr(b, e - b + 1);
+}
+
+int PosixTransport::get(const std::string& url, const DataCallback& on_data,
+                        HttpValidators* validators) {
+  if (url.compare(0, 7, "http://") != 0) {
+    ESP_LOGE(TAG, "Host transport only supports plain http:// URLs: %s",
+             url.c_str());
+    return -1;
+  }
+
+  size_t slash = url.find('/', 7);
+  std::string hostport =
+      url.substr(7, slash == std::string::npos ? std::string::npos : slash - 7);
+  std::string path = slash == std::string::npos ? "/" : url.substr(slash);
+  std::string host = hostport;
+  uint16_t port = 80;
+  size_t colon = hostport.rfind(':');
+  if (colon != std::string::npos) {
+    host = hostport.substr(0, colon);
+    port = (uint16_t)atoi(hostport.c_str() + colon + 1);
+  }
+
+  if (this->fd_ >= 0 && (host != this->host_ || port != this->port_))
+    this->close();
+
+  this->timing_ = HttpTiming{};
+  bool reused = this->fd_ >= 0;
+  if (!reused && !this->connect_(host, port)) return -1;
+
+  bool got_response = false;
+  const uint32_t start_us = micros();
+  int status =
+      this->request_(hostport, path, on_data, validators, got_response);
+  // A dropped idle keep-alive connection fails at once; one that ran into
+  // the timeout is a dead link, and a retry would only wait as long again
+  if (status < 0 && reused && !got_response &&
+      micros() - start_us < TIMEOUT_MS * 1000u) {
+    ESP_LOGD(TAG, "Request failed, retrying on a new connection");
+    reused = false;
+    if (!this->connect_(host, port)) return -1;
+    status =
+        this->request_(hostport, path, on_data, validators, got_response);
+  }
+  if (got_response) {
+    this->responses_++;
+    if (reused) this->reused_++;
+  }
+  ESP_LOGD(TAG, "HTTP status: %d for %s", status, url.c_str());
+  return status;
+}
+
+int PosixTransport::request_(const std::string& hostport,
+                             const std::string& path,
+                             const DataCallback& on_data,
+                             HttpValidators* validators, bool& got_response) {
+  got_response = false;
+  const uint32_t sent_us = micros();
+  this->timing_.body_bytes = 0;
+  this->begin_body_();
+
+  std::string req = "GET " + path + " HTTP/1.1\r\nHost: " + hostport +
+                    "\r\nAccept: application/json\r\n"
+                    "Connection: keep-alive\r\n";
+#ifdef WEATHER_BOM_GZIP
+  if (this->gzip_) req += "Accept-Encoding: gzip\r\n";
+#endif
+  if (validators && !validators->etag.empty())
+    req += "If-None-Match: " + validators->etag + "\r\n";
+  if (validators && !validators->last_modified.empty())
+    req += "If-Modified-Since: " + validators->last_modified + "\r\n";
+  req += "\r\n";
+  std::string line;
+  if (!this->send_all_(req) || !this->read_line_(line)) {
+    this->close();
+    return -1;
+  }
+  got_response = true;
+  const uint32_t headers_us = micros();
+  this->timing_.ttfb_us = headers_us - sent_us;
+
+  // Status line, e.g. "HTTP/1.1 200 OK"
+  size_t sp = line.find(' ');
+  int status = sp == std::string::npos ? -1 : atoi(line.c_str() + sp + 1);
+  if (line.compare(0, 5, "HTTP/") != 0 || status <= 0) {
+    ESP_LOGW(TAG, "Malformed status line: %s", line.c_str());
+    this->close();
+    return -1;
+  }
+
+  bool keep_alive = line.compare(0, 8, "HTTP/1.1") == 0;
+  bool chunked = false;
+  long content_length = -1;
+  HttpValidators received;
+  while (true) {
+    if (!this->read_line_(line)) {
+      this->close();
+      return -1;
+    }
+    if (line.empty()) break;
+    size_t c = line.find(':');
+    if (c == std::string::npos) continue;
+    std::string name = to_lower(line.substr(0, c));
+    std::string raw_value = trim(line.substr(c + 1));
+    std::string value = to_lower(raw_value);
+    if (name == "etag") {
+      received.etag = raw_value;
+    } else if (name == "last-modified") {
+      received.last_modified = raw_value;
+    } else if (name == "content-encoding") {
+      this->content_encoding_(value.c_str());
+    } else if (name == "content-length") {
+      content_length = atol(value.c_str());
+    } else if (name == "transfer-encoding") {
+      chunked = value.find("chunked") != std::string::npos;
+    } else if (name == "connection") {
+      if (value == "close") keep_alive = false;
+      if (value == "keep-alive") keep_alive = true;
+    }
+  }
+
+  bool ok = true;
+  if (status == 204 || status == 304 || status < 200) {
+    // no body
+  } else if (chunked) {
+    while (ok) {
+      ok = this->read_line_(line);
+      if (!ok) break;
+      size_t n = strtoul(line.c_str(), nullptr, 16);
+      if (n == 0) {
+        // Trailers up to the terminating blank line
+        while ((ok = this->read_line_(line)) && !line.empty()) {
+        }
+        break;
+      }
+      ok = this->read_body_(n, status, on_data) && this->read_line_(line);
+    }
+  } else if (content_length >= 0) {
+    ok = this->read_body_((size_t)content_length, status, on_data);
+  } else {
+    ok = this->read_body_(SIZE_MAX, status, on_data);
+    keep_alive = false;
+  }
+
+  if (!ok) {
+    ESP_LOGW(TAG, "Connection lost while reading body");
+    this->close();
+    return -1;
+  }
+  this->timing_.download_us = micros() - headers_us;
+  if (!keep_alive) this->close();
+  if (status == 200 && !this->body_complete_()) {
+    ESP_LOGW(TAG, "Incomplete gzip body");
+    return -1;
+  }
+  if (status == 200 && validators) *validators = std::move(received);
+  return status;
+}
+
+bool PosixTransport::connect_(const std::string& host, uint16_t port) {
+  this->close();
+  const uint32_t start_us = micros();
+
+  struct addrinfo hints {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* res = nullptr;
+  std::string port_str = std::to_string(port);
+  int rc = getaddrinfo(host.c_str(), port_str.c_str(), &hints, &res);
+  if (rc != 0) {
+    ESP_LOGE(TAG, "Cannot resolve %s: %s", host.c_str(), gai_strerror(rc));
+    return false;
+  }
+
+  struct timeval tv {};
+  tv.tv_sec = TIMEOUT_MS / 1000;
+  tv.tv_usec = (TIMEOUT_MS % 1000) * 1000;
+  for (struct addrinfo* ai = res; ai != nullptr; ai = ai->ai_next) {
+    int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) continue;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+      this->fd_ = fd;
+      break;
+    }
+    ::close(fd);
+  }
+  freeaddrinfo(res);
+
+  if (this->fd_ < 0) {
+    ESP_LOGE(TAG, "Cannot connect to %s:%u", host.c_str(), port);
+    return false;
+  }
+  this->host_ = host;
+  this->port_ = port;
+  this->timing_.connect_us = micros() - start_us;
+  return true;
+}
+
+void PosixTransport::close() {
+  if (this->fd_ >= 0) ::close(this->fd_);
+  this->fd_ = -1;
+  this->buf_pos_ = this->buf_len_ = 0;
+}
+
+bool PosixTransport::send_all_(const std::string& data) {
+  size_t off = 0;
+  while (off < data.size()) {
+    ssize_t n = send(this->fd_, data.data() + off, data.size() - off,
+                     MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    off += (size_t)n;
+  }
+  return true;
+}
+
+bool PosixTransport::fill_() {
+  this->buf_pos_ = this->buf_len_ = 0;
+  ssize_t n = recv(this->fd_, this->buf_, sizeof(this->buf_), 0);
+  if (n <= 0) return false;
+  this->buf_len_ = (size_t)n;
+  return true;
+}
+
+bool PosixTransport::read_line_(std::string& line) {
+  line.clear();
+  while (true) {
+    if (this->buf_pos_ == this->buf_len_ && !this->fill_()) return false;
+    char c = this->buf_[this->buf_pos_++];
+    if (c == '\n') {
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+      return true;
+    }
+    if (line.size() < sizeof(this->buf_)) line += c;
+  }
+}
+
+// Hands len body bytes to on_data (only for a 200). SIZE_MAX reads until the
+// peer closes the connection.
+bool PosixTransport::read_body_(size_t len, int status,
+                                const DataCallback& on_data) {
+  while (len > 0) {
+    if (this->buf_pos_ == this->buf_len_ && !this->fill_())
+      return len == SIZE_MAX;
+    size_t n = this->buf_len_ - this->buf_pos_;
+    if (n > len) n = len;
+    this->timing_.body_bytes += n;
+    if (status == 200) this->deliver_(on_data, this->buf_ + this->buf_pos_, n);
+    this->buf_pos_ += n;
+    if (len != SIZE_MAX) len -= n;
+  }
+  return true;
+}
+
+}  // namespace weather_bom
+}  // namespace esphome
+
+#endif  // USE_HOST
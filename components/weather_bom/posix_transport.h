@@ -0,0 +1,45 @@
+#pragma once
+#ifdef USE_HOST
+
+#include "http_transport.h"
+
+namespace esphome {
+namespace weather_bom {
+
+// Minimal HTTP/1.1 client over POSIX sockets for the host (Linux) build.
+// Plain http:// only; meant for a local stand-in server such as
+// tools/bom_stub_server.py. Supports Content-Length, chunked and
+// read-until-close bodies, and keeps the connection alive between calls.
+class PosixTransport : public HttpTransport {
+ public:
+  ~PosixTransport() override { this->close(); }
+
+  int get(const std::string &url, const DataCallback &on_data,
+          HttpValidators *validators = nullptr) override;
+  void close() override;
+
+ protected:
+  int request_(const std::string &hostport, const std::string &path,
+               const DataCallback &on_data, HttpValidators *validators,
+               bool &got_response);
+  bool connect_(const std::string &host, uint16_t port);
+  bool send_all_(const std::string &data);
+  bool fill_();
+  bool read_line_(std::string &line);
+  bool read_body_(size_t len, int status, const DataCallback &on_data);
+
+  static constexpr int TIMEOUT_MS = 5000;
+
+  int fd_{-1};
+  std::string host_;
+  uint16_t port_{0};
+
+  char buf_[1024];
+  size_t buf_pos_{0};
+  size_t buf_len_{0};
+};
+
+}  // namespace weather_bom
+}  // namespace esphome
+
+#endif  // USE_HOST
@@ -0,0 +1,74 @@
+#include "publish_filter.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace esphome {
+namespace weather_bom {
+
+static uint32_t fnv1a(const char* s) {
+  uint32_t h = 2166136261u;
+  for (; *s; s++) {
+    h ^= (uint8_t)*s;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static uint32_t float_bits(float v) {
+  uint32_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  return bits;
+}
+
+static bool same_float(uint32_t a_bits, uint32_t b_bits, float eps) {
+  float a, b;
+  memcpy(&a, &a_bits, sizeof(a));
+  memcpy(&b, &b_bits, sizeof(b));
+  if (std::isnan(a) || std::isnan(b)) return std::isnan(a) && std::isnan(b);
+  return std::fabs(a - b) < eps;
+}
+
+static bool same_hash(uint32_t a, uint32_t b, float) { return a == b; }
+
+bool PublishFilter::update_(const void* entity, uint32_t value,
+                            bool (*same)(uint32_t, uint32_t, float),
+                            float eps) {
+  for (auto& slot : this->slots_) {
+    if (slot.entity != entity) continue;
+    if (same(slot.value, value, eps)) {
+      this->suppressed_++;
+      return false;
+    }
+    slot.value = value;
+    return true;
+  }
+  this->slots_.push_back({entity, value});
+  return true;
+}
+
+bool PublishFilter::publish(sensor::Sensor* s, float value) {
+  if (s == nullptr) return false;
+  int8_t decimals = s->get_accuracy_decimals();
+  float eps = 0.5f * std::pow(10.0f, -(float)(decimals < 0 ? 0 : decimals));
+  if (!this->update_(s, float_bits(value), same_float, eps)) return false;
+  s->publish_state(value);
+  return true;
+}
+
+bool PublishFilter::publish(text_sensor::TextSensor* t, const char* value) {
+  if (t == nullptr) return false;
+  if (!this->update_(t, fnv1a(value), same_hash, 0)) return false;
+  t->publish_state(value);
+  return true;
+}
+
+bool PublishFilter::publish(binary_sensor::BinarySensor* b, bool value) {
+  if (b == nullptr) return false;
+  if (!this->update_(b, value, same_hash, 0)) return false;
+  b->publish_state(value);
+  return true;
+}
+
+}  // namespace weather_bom
+}  // namespace esphome
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "esphome/components/binary_sensor/binary_sensor.h"
+#include "esphome/components/sensor/sensor.h"
+#include "esphome/components/text_sensor/text_sensor.h"
+
+namespace esphome {
+namespace weather_bom {
+
+// Remembers the last value handed to each entity and drops publishes that
+// would not change what a client sees. Floats match within half a unit of
+// the sensor's accuracy_decimals; strings are compared by FNV-1a hash. Each
+// entity costs 8 bytes.
+class PublishFilter {
+ public:
+  // Both return true if the value was published. Null entities are ignored.
+  bool publish(sensor::Sensor *s, float value);
+  bool publish(text_sensor::TextSensor *t, const char *value);
+  bool publish(binary_sensor::BinarySensor *b, bool value);
+
+  uint32_t suppressed() const { return this->suppressed_; }
+
+ protected:
+  struct Slot {
+    const void *entity;
+    uint32_t value;  // float bits or string hash
+  };
+
+  // Stores value for entity; false if it was already there
+  bool update_(const void *entity, uint32_t value,
+               bool (*same)(uint32_t, uint32_t, float), float eps);
+
+  std::vector<Slot> slots_;
+  uint32_t suppressed_{0};
+};
+
+}  // namespace weather_bom
+}  // namespace esphome
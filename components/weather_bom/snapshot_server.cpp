@@ -0,0 +1,125 @@
+#include "snapshot_server.h"
+#ifdef WEATHER_BOM_SNAPSHOT_SERVER
+
+#include <cstdio>
+
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace weather_bom {
+
+static const char* const TAG = "weather_bom.server";
+
+void SnapshotServer::add_location(WeatherBOM* location, const std::string& id) {
+  const std::string path = "/weather_bom/" + id;
+  this->served_.push_back({location, path, 0, {},
+                           std::make_unique<SnapshotBlob>(), path + "/history",
+                           0, 0, nullptr});
+}
+
+void SnapshotServer::setup() {
+  auto* base = web_server_base::global_web_server_base;
+  if (base == nullptr) {
+    ESP_LOGE(TAG, "No web server to serve snapshots from");
+    this->mark_failed();
+    return;
+  }
+  this->boot_id_ = random_uint32();
+  base->init();
+  base->add_handler(this);
+}
+
+void SnapshotServer::dump_config() {
+  ESP_LOGCONFIG(TAG, "Weather BOM Snapshot Server:");
+  for (const auto& s : this->served_) {
+    ESP_LOGCONFIG(TAG, "  Serving %s", s.path.c_str());
+    if (s.location->history_)
+      ESP_LOGCONFIG(TAG, "  Serving %s", s.history_path.c_str());
+  }
+}
+
+void SnapshotServer::loop() {
+  for (auto& s : this->served_) {
+    const WeatherBOM* loc = s.location;
+    const bool history =
+        loc->history_ && loc->history_version_ != s.history_version;
+    if (loc->data_version_ == s.version && !history) continue;
+    // A request is being answered from the copies; next pass
+    if (!this->lock_.try_lock()) return;
+    if (loc->data_version_ != s.version) {
+      SnapshotBlob& blob = *s.blob;
+      blob.magic = SnapshotBlob::MAGIC;
+      blob.version = SNAPSHOT_VERSION;
+      blob.size = sizeof(WeatherSnapshot);
+      blob.data = loc->results_[loc->front_].data;
+      s.version = loc->data_version_;
+      snprintf(s.etag, sizeof(s.etag), "\"%08x%08x\"",
+               (unsigned)this->boot_id_, (unsigned)s.version);
+    }
+    if (history) {
+      if (!s.history)
+        s.history = std::make_unique<uint8_t[]>(ObservationHistory::DUMP_MAX);
+      s.history_len =
+          loc->history_->dump(s.history.get(), ObservationHistory::DUMP_MAX);
+      s.history_version = loc->history_version_;
+    }
+    this->lock_.unlock();
+  }
+}
+
+bool SnapshotServer::canHandle(AsyncWebServerRequest* request) const {
+  if (request->method() != HTTP_GET) return false;
+  const std::string url = request->url();
+  for (const auto& s : this->served_) {
+    if (url == s.path || url == s.history_path) return true;
+  }
+  return false;
+}
+
+void SnapshotServer::handleRequest(AsyncWebServerRequest* request) {
+  const std::string url = request->url();
+  LockGuard guard(this->lock_);
+  for (const auto& s : this->served_) {
+    if (url == s.path) {
+      if (s.version == 0) {
+        // Nothing fetched or restored yet; the client retries on its backoff
+        request->send(503);
+        return;
+      }
+      send_(request, reinterpret_cast<const uint8_t*>(s.blob.get()),
+            sizeof(SnapshotBlob), s.etag);
+      return;
+    }
+    if (url == s.history_path) {
+      if (s.history_len == 0) {
+        request->send(503);
+        return;
+      }
+      char etag[20];
+      snprintf(etag, sizeof(etag), "\"%08x%08x\"", (unsigned)~this->boot_id_,
+               (unsigned)s.history_version);
+      send_(request, s.history.get(), s.history_len, etag);
+      return;
+    }
+  }
+  request->send(404);
+}
+
+void SnapshotServer::send_(AsyncWebServerRequest* request, const uint8_t* body,
+                           size_t len, const char* etag) {
+  auto inm = request->get_header("If-None-Match");
+  if (inm.has_value() && *inm == etag) {
+    request->send(304);
+    return;
+  }
+  AsyncWebServerResponse* response =
+      request->beginResponse(200, "application/octet-stream", body, len);
+  response->addHeader("ETag", etag);
+  request->send(response);
+  ESP_LOGV(TAG, "Served %s", request->url().c_str());
+}
+
+}  // namespace weather_bom
+}  // namespace esphome
+
+#endif  // WEATHER_BOM_SNAPSHOT_SERVER
@@ -0,0 +1,68 @@
+#pragma once
+#include "esphome/core/defines.h"
+#ifdef WEATHER_BOM_SNAPSHOT_SERVER
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "esphome/components/web_server_base/web_server_base.h"
+#include "esphome/core/component.h"
+#include "esphome/core/helpers.h"
+#include "weather_bom.h"
+
+namespace esphome {
+namespace weather_bom {
+
+// Serves the data of serve_snapshot blocks to snapshot_url clients on the
+// LAN, so a site with many displays has one node talking to BOM: GET
+// /weather_bom/<block id> answers with a SnapshotBlob, or 304 when the
+// client's ETag is still current. Clients decode nothing but a header.
+// Blocks with an observation history also serve its dump at
+// /weather_bom/<block id>/history, for displays drawing sparklines.
+//
+// Requests arrive on the web server's task. Each block's blob is a copy
+// taken from loop() whenever the block's data changed, and the lock is only
+// held while a copy is made or sent; loop() skips a pass rather than wait.
+class SnapshotServer : public AsyncWebHandler, public Component {
+ public:
+  // Served at /weather_bom/<id>
+  void add_location(WeatherBOM *location, const std::string &id);
+
+  bool canHandle(AsyncWebServerRequest *request) const override;
+  void handleRequest(AsyncWebServerRequest *request) override;
+
+  void setup() override;
+  void loop() override;
+  void dump_config() override;
+  float get_setup_priority() const override {
+    return setup_priority::WIFI - 1.0f;
+  }
+
+ protected:
+  struct Served {
+    WeatherBOM *location;
+    std::string path;
+    uint32_t version;  // block's data_version_ of the copy, 0 if none yet
+    char etag[20];
+    std::unique_ptr<SnapshotBlob> blob;
+    std::string history_path;
+    uint32_t history_version;  // block's history_version_ of the dump
+    size_t history_len;
+    std::unique_ptr<uint8_t[]> history;
+  };
+
+  // Answers with body and its ETag, or 304 if the client has that one
+  static void send_(AsyncWebServerRequest *request, const uint8_t *body,
+                    size_t len, const char *etag);
+
+  std::vector<Served> served_;
+  // A fresh boot may reach a version a client saw before the reboot
+  uint32_t boot_id_{0};
+  Mutex lock_;
+};
+
+}  // namespace weather_bom
+}  // namespace esphome
+
+#endif  // WEATHER_BOM_SNAPSHOT_SERVER
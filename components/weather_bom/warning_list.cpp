@@ -0,0 +1,38 @@
+#include "warning_list.h"
+
+#include <cstring>
+
+namespace esphome {
+namespace weather_bom {
+
+bool WarningData::cancelled() const {
+  return strcmp(this->phase, "cancelled") == 0;
+}
+
+void WarningList::push(const WarningData& w) {
+  if (this->count_ == CAPACITY) {
+    if (this->dropped_ < UINT8_MAX) this->dropped_++;
+    return;
+  }
+  this->items_[this->count_++] = w;
+}
+
+uint8_t WarningList::active() const {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < this->count_; i++) {
+    if (!this->items_[i].cancelled()) n++;
+  }
+  return n;
+}
+
+WarningSeverity WarningList::max_severity() const {
+  uint8_t max = WARNING_SEVERITY_NONE;
+  for (uint8_t i = 0; i < this->count_; i++) {
+    const WarningData& w = this->items_[i];
+    if (!w.cancelled() && w.severity > max) max = w.severity;
+  }
+  return (WarningSeverity)max;
+}
+
+}  // namespace weather_bom
+}  // namespace esphome
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+
+namespace esphome {
+namespace weather_bom {
+
+// warning_group_type, in increasing order
+enum WarningSeverity : uint8_t {
+  WARNING_SEVERITY_NONE = 0,
+  WARNING_SEVERITY_MINOR,
+  WARNING_SEVERITY_MAJOR,
+};
+
+// One element of /warnings. Strings are cut to fit; hash covers the whole
+// element as received, so any reissue, phase change or edit changes it.
+struct WarningData {
+  char id[32];
+  char type[40];
+  char title[96];
+  char phase[12];         // new, update, renewal, ..., cancelled
+  uint8_t severity;       // WarningSeverity
+  uint32_t issue_time;    // epoch seconds, 0 if absent
+  uint32_t expiry_time;
+  uint32_t hash;
+
+  bool cancelled() const;
+};
+
+// The warnings of one response, in BOM's order, in a fixed-size array. Plain
+// data like HourlyRing, so it can sit in the result buffers and the flash
+// snapshot; elements past CAPACITY are counted but not kept.
+class WarningList {
+ public:
+  static constexpr uint8_t CAPACITY = 8;
+
+  void clear() { this->count_ = this->dropped_ = 0; }
+  uint8_t size() const { return this->count_; }
+  uint8_t dropped() const { return this->dropped_; }
+  void push(const WarningData &w);
+  const WarningData &get(uint8_t i) const { return this->items_[i]; }
+  // Warnings not yet cancelled, and the highest severity among them
+  uint8_t active() const;
+  WarningSeverity max_severity() const;
+
+ protected:
+  WarningData items_[CAPACITY];
+  uint8_t count_{0};
+  uint8_t dropped_{0};
+};
+
+}  // namespace weather_bom
+}  // namespace esphome
@@ -1,27 +1,91 @@
 #include "weather_bom.h"
 
+#include <algorithm>
+#include <cctype>
 #include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <memory>
 
-#include "cJSON.h"
-#include "esp_crt_bundle.h"
-#include "esp_http_client.h"
-#include "esphome/components/wifi/wifi_component.h"
+#include "fetch_engine.h"
+#include "geohash.h"
+#include "esphome/components/network/util.h"
 #include "esphome/core/application.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
 #include "esphome/core/log.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
+#ifdef WEATHER_BOM_BATTERY
+#include "esp_attr.h"
+#include "esp_rom_crc.h"
+#ifdef USE_API
+#include "esphome/components/api/api_server.h"
+#endif
+#endif
 
 namespace esphome {
 namespace weather_bom {
 
 static const char* const TAG = "weather_bom";
 
+static const char* const ENDPOINT_NAMES[ENDPOINT_COUNT] = {
+    "Observations", "Forecast", "Warnings", "Hourly"};
+static const char* const DAY_SENSOR_NAMES[DAY_SENSOR_COUNT] = {
+    "Min", "Max", "Rain Chance", "Rain Min", "Rain Max"};
+static const char* const DAY_TEXT_NAMES[DAY_TEXT_COUNT] = {
+    "Summary", "Icon", "Sunrise", "Sunset"};
+static const char* const CIRCUIT_NAMES[] = {"closed", "open", "half_open"};
+// warning_group_type values, by WarningSeverity
+static const char* const SEVERITY_NAMES[] = {"", "minor", "major"};
+
+// A new forecast issue is usually live within a minute or two of its
+// advertised time; poll this long after it, and re-poll at RETRY until it
+// shows up.
+static constexpr int64_t FORECAST_ISSUE_GRACE_S = 120;
+static constexpr int64_t FORECAST_ISSUE_RETRY_S = 300;
+// Anything earlier means the clock has not been set by SNTP yet
+static constexpr time_t MIN_VALID_EPOCH = 1700000000;
+// Flash wears; restored data a little older than the last fetch is fine
+static constexpr uint32_t SNAPSHOT_SAVE_INTERVAL_MS = 15 * 60 * 1000;
+
 void WeatherBOM::dump_config() {
   ESP_LOGCONFIG(TAG, "Weather BOM:");
   LOG_UPDATE_INTERVAL(this);
-
-  if (!this->geohash_.empty()) {
+  for (uint8_t i = 0; i < ENDPOINT_COUNT; i++) {
+    uint32_t ms = this->endpoints_[i].interval_ms;
+    if (!(this->enabled_mask_ & (1 << i))) {
+      ESP_LOGCONFIG(TAG, "  %s: not used", ENDPOINT_NAMES[i]);
+    } else if (ms == SCHEDULER_DONT_RUN) {
+      ESP_LOGCONFIG(TAG, "  %s Interval: never", ENDPOINT_NAMES[i]);
+    } else {
+      ESP_LOGCONFIG(TAG, "  %s Interval: %.1fs%s", ENDPOINT_NAMES[i],
+                    ms / 1000.0f,
+                    i == ENDPOINT_FORECAST ? " (max, follows issue times)" : "");
+    }
+  }
+  ESP_LOGCONFIG(TAG, "  Retry: after %.0fs, doubling up to %.0fs",
+                this->retry_initial_ms_ / 1000.0f,
+                this->retry_max_ms_ / 1000.0f);
+  ESP_LOGCONFIG(TAG, "  Circuit Opens After: %u failures",
+                this->breaker_threshold_);
+  if (this->snapshot_url_.empty())
+    ESP_LOGCONFIG(TAG, "  API Base URL: %s", this->api_base_url_.c_str());
+  if (this->enabled_mask_ & (1 << ENDPOINT_HOURLY))
+    ESP_LOGCONFIG(TAG, "  Hourly Forecast: %u hours", this->hourly_hours_);
+  ESP_LOGCONFIG(TAG, "  Warm Start: %s", YESNO(this->warm_start_));
+#ifdef WEATHER_BOM_BATTERY
+  ESP_LOGCONFIG(TAG, "  Battery Mode: %s", YESNO(this->deep_sleep_ != nullptr));
+  LOG_SENSOR("  ", "Awake Time", this->awake_time_);
+#endif
+#ifdef USE_ESP_IDF
+  LOG_SENSOR("  ", "Task Stack Free", this->task_stack_free_);
+#endif
+
+  if (!this->snapshot_url_.empty()) {
+    ESP_LOGCONFIG(TAG, "  Snapshot URL: %s", this->snapshot_url_.c_str());
+  } else if (!this->geohash_.empty()) {
     ESP_LOGCONFIG(TAG, "  Geohash: %s", this->geohash_.c_str());
   } else if (this->have_static_lat_ && this->have_static_lon_) {
     ESP_LOGCONFIG(TAG, "  Static Latitude: %.6f", this->static_lat_);
@@ -29,6 +93,9 @@ void WeatherBOM::dump_config() {
   } else if (this->lat_sensor_ && this->lon_sensor_) {
     ESP_LOGCONFIG(TAG, "  Latitude Sensor: yes");
     ESP_LOGCONFIG(TAG, "  Longitude Sensor: yes");
+    ESP_LOGCONFIG(TAG, "  Movement Threshold: %.0f m, debounce %.1fs",
+                  this->movement_threshold_m_,
+                  this->movement_debounce_ms_ / 1000.0f);
   } else {
     ESP_LOGCONFIG(TAG, "  No location configured");
   }
@@ -36,185 +103,1004 @@ void WeatherBOM::dump_config() {
   LOG_SENSOR("  ", "Temperature", this->temperature_);
   LOG_SENSOR("  ", "Humidity", this->humidity_);
   LOG_SENSOR("  ", "Wind Speed KMH", this->wind_kmh_);
-  LOG_SENSOR("  ", "Today Min", this->today_min_);
-  LOG_SENSOR("  ", "Today Max", this->today_max_);
-  LOG_SENSOR("  ", "Today Rain Chance", this->today_rain_chance_);
-  LOG_SENSOR("  ", "Today Rain Min", this->today_rain_min_);
-  LOG_SENSOR("  ", "Today Rain Max", this->today_rain_max_);
-  LOG_TEXT_SENSOR("  ", "Today Summary", this->today_summary_);
-  LOG_TEXT_SENSOR("  ", "Today Icon", this->today_icon_);
-  LOG_TEXT_SENSOR("  ", "Today Sunrise", this->today_sunrise_);
-  LOG_TEXT_SENSOR("  ", "Today Sunset", this->today_sunset_);
-
-  LOG_SENSOR("  ", "Tomorrow Min", this->tomorrow_min_);
-  LOG_SENSOR("  ", "Tomorrow Max", this->tomorrow_max_);
-  LOG_SENSOR("  ", "Tomorrow Rain Chance", this->tomorrow_rain_chance_);
-  LOG_SENSOR("  ", "Tomorrow Rain Min", this->tomorrow_rain_min_);
-  LOG_SENSOR("  ", "Tomorrow Rain Max", this->tomorrow_rain_max_);
-  LOG_TEXT_SENSOR("  ", "Tomorrow Summary", this->tomorrow_summary_);
-  LOG_TEXT_SENSOR("  ", "Tomorrow Icon", this->tomorrow_icon_);
-  LOG_TEXT_SENSOR("  ", "Tomorrow Sunrise", this->tomorrow_sunrise_);
-  LOG_TEXT_SENSOR("  ", "Tomorrow Sunset", this->tomorrow_sunset_);
+  if (this->history_) {
+    ESP_LOGCONFIG(TAG, "  History: %u slots of %us",
+                  ObservationHistory::CAPACITY,
+                  (unsigned)this->history_->resolution());
+  }
+  for (auto* s : this->history_sensors_) LOG_SENSOR("  ", "History", s);
+  for (uint8_t d = 0; d < FORECAST_DAYS; d++) {
+    char name[32];
+    for (uint8_t f = 0; f < DAY_SENSOR_COUNT; f++) {
+      snprintf(name, sizeof(name), "Day %u %s", d, DAY_SENSOR_NAMES[f]);
+      LOG_SENSOR("  ", name, this->day_sensors_[d][f]);
+    }
+    for (uint8_t f = 0; f < DAY_TEXT_COUNT; f++) {
+      snprintf(name, sizeof(name), "Day %u %s", d, DAY_TEXT_NAMES[f]);
+      LOG_TEXT_SENSOR("  ", name, this->day_texts_[d][f]);
+    }
+  }
 
   LOG_TEXT_SENSOR("  ", "Warnings JSON", this->warnings_json_);
+  LOG_SENSOR("  ", "Warnings Count", this->warnings_count_);
+  LOG_SENSOR("  ", "Warnings Max Severity", this->warnings_max_severity_);
   LOG_TEXT_SENSOR("  ", "Location Name", this->location_name_);
   LOG_TEXT_SENSOR("  ", "Out Geohash", this->out_geohash_);
   LOG_TEXT_SENSOR("  ", "Last Update", this->last_update_);
+  LOG_BINARY_SENSOR("  ", "Data Stale", this->data_stale_);
+  LOG_SENSOR("  ", "TLS Handshakes Avoided", this->handshakes_avoided_);
+  LOG_SENSOR("  ", "Publishes Suppressed", this->publishes_suppressed_);
+  LOG_SENSOR("  ", "Time To First Data", this->first_data_time_);
+  LOG_SENSOR("  ", "Heap Min Free", this->heap_min_free_);
+  LOG_SENSOR("  ", "Heap Largest Block", this->heap_largest_block_);
+  LOG_SENSOR("  ", "Heap Largest Block Before", this->heap_block_before_);
+  LOG_SENSOR("  ", "Heap Largest Block After", this->heap_block_after_);
+  LOG_SENSOR("  ", "Parse Arena Used", this->arena_used_);
+  LOG_SENSOR("  ", "Parse Arena Fallbacks", this->arena_fallbacks_);
+  for (auto& ep : this->endpoints_) {
+    LOG_SENSOR("  ", "Cache Hits", ep.hits_sensor);
+    LOG_SENSOR("  ", "Cache Misses", ep.misses_sensor);
+    for (auto* s : ep.telemetry_sensors) LOG_SENSOR("  ", "Telemetry", s);
+    LOG_TEXT_SENSOR("  ", "Circuit", ep.circuit_text);
+  }
 }
 
 void WeatherBOM::setup() {
+  // Endpoints are scheduled individually from loop(); update() only forces a
+  // full refresh
+  this->stop_poller();
+  for (auto& ep : this->endpoints_) {
+    if (ep.interval_ms == 0) ep.interval_ms = this->get_update_interval();
+  }
+  this->enabled_mask_ &= COMPILED_ENDPOINTS;
+  if (this->enabled_mask_ == 0) this->enabled_mask_ = LOCATION_SEARCH;
+  this->forced_mask_ = this->enabled_mask_;  // first fetch once network is up
+
   ESP_LOGD(TAG, "Setting up WeatherBOM...");
+#ifdef WEATHER_BOM_FETCH_OBSERVATIONS
+  // Fixed size (under 2 KB), taken once
+  if (this->history_interval_ms_ != 0) {
+    this->history_ = std::make_unique<ObservationHistory>();
+    this->history_->set_resolution(this->history_interval_ms_ / 1000);
+  }
+#endif
+  this->restore_snapshot_();
 
   // Dynamic GPS handling
   if (this->lat_sensor_) {
     this->lat_sensor_->add_on_state_callback([this](float v) {
       this->dynamic_lat_ = v;
-      this->have_dynamic_ = !std::isnan(v) && !std::isnan(this->dynamic_lon_);
-      if (this->have_dynamic_ && this->geohash_.empty()) this->update();
+      this->on_position_();
     });
   }
 
   if (this->lon_sensor_) {
     this->lon_sensor_->add_on_state_callback([this](float v) {
       this->dynamic_lon_ = v;
-      this->have_dynamic_ = !std::isnan(this->dynamic_lat_) && !std::isnan(v);
-      if (this->have_dynamic_ && this->geohash_.empty()) this->update();
+      this->on_position_();
     });
   }
 
-  // Publish static geohash (if configured at startup)
-  if (!this->geohash_.empty() && this->out_geohash_) {
-    this->out_geohash_->publish_state(this->geohash_);
+  // Static geohash (if configured) and any restored data go out right away
+  WeatherSnapshot& front = this->results_[this->front_].data;
+  if (!this->geohash_.empty())
+    json_copy_string(front.geohash, sizeof(front.geohash),
+                     this->geohash_.c_str());
+  this->publish_slice_ = 0;
+  while (this->publish_next_slice_()) {
   }
 }
 
 void WeatherBOM::loop() {
-  // Only run once after boot
-  if (!this->initial_fetch_done_) {
-    if (wifi::global_wifi_component != nullptr &&
-        wifi::global_wifi_component->is_connected()) {
-      ESP_LOGD(TAG, "WiFi connected after boot — fetching weather now");
-      this->initial_fetch_done_ = true;
-      this->update();
+  if (!this->running_.load(std::memory_order_acquire)) {
+    if (this->work_ != nullptr) this->take_results_();
+    this->schedule_();
+  }
+
+#ifdef WEATHER_BOM_FETCH_HOURLY
+  // "In N hours" entities move on with the clock as well as with new data
+  const time_t now = ::time(nullptr);
+  if (!this->hourly_sensors_.empty() && now >= MIN_VALID_EPOCH &&
+      now / 3600 != this->hourly_published_hour_) {
+    HourlyRing& hourly = this->results_[this->front_].data.hourly;
+    hourly.drop_before(now);
+    this->publish_hourly_(hourly);
+  }
+#endif
+
+  this->publish_next_slice_();
+#ifdef WEATHER_BOM_BATTERY
+  if (this->deep_sleep_ != nullptr) this->sleep_if_done_();
+#endif
+}
+
+void WeatherBOM::schedule_() {
+  // Preferences are not thread-safe; persist what the last cycle learned here
+  this->save_snapshot_if_due_();
+  if (!network::is_connected()) return;
+
+  const uint32_t now = millis();
+  uint8_t mask = 0;
+  for (uint8_t i = 0; i < ENDPOINT_COUNT; i++) {
+    const EndpointState& ep = this->endpoints_[i];
+    // A failed endpoint retries on its backoff timer even if set to never
+    if ((ep.interval_ms != SCHEDULER_DONT_RUN || ep.failures > 0) &&
+        (int32_t)(now - ep.next_due_ms) >= 0) {
+      mask |= 1 << i;
+    } else if ((this->forced_mask_ & (1 << i)) &&
+               ep.circuit == CIRCUIT_CLOSED) {
+      // A forced refresh skips the backoff, but not an open circuit
+      mask |= 1 << i;
     }
   }
+  // Only while there is no geohash, which the search is there to find
+  if (this->geohash_.empty()) mask |= this->forced_mask_ & LOCATION_SEARCH;
+  // Picked up by the engine once its worker is free
+  this->requested_mask_ |= mask & this->enabled_mask_;
 }
 
 void WeatherBOM::update() {
-  if (this->running_) {
-    ESP_LOGD(TAG, "Fetch already running, skipping...");
-    return;
-  }
+  // Manual refresh (e.g. component.update): every endpoint, next loop()
+  this->forced_mask_ = this->enabled_mask_;
+}
 
-  if (wifi::global_wifi_component == nullptr ||
-      !wifi::global_wifi_component->is_connected()) {
-    ESP_LOGW(TAG, "WiFi not connected, skipping fetch.");
-    return;
+// Called by the engine, on the main loop, as it starts a cycle with this block
+void WeatherBOM::begin_cycle_(uint8_t mask) {
+  // Results of the last cycle not yet taken would be overwritten below
+  if (this->work_ != nullptr) this->take_results_();
+  this->forced_mask_ &= ~mask;
+
+  // Failures retry at the normal cadence; do_fetch() pulls the forecast in
+  // once it knows the next issue time
+  const uint32_t now = millis();
+  for (uint8_t i = 0; i < ENDPOINT_COUNT; i++) {
+    if (!(mask & (1 << i))) continue;
+    EndpointState& ep = this->endpoints_[i];
+    ep.next_due_ms = now + ep.interval_ms;
+    if (ep.failures > 0) ep.retries++;
+    if (ep.circuit == CIRCUIT_OPEN) {
+      ep.circuit = CIRCUIT_HALF_OPEN;
+      this->filter_.publish(ep.circuit_text, CIRCUIT_NAMES[ep.circuit]);
+    }
   }
 
-  this->running_ = true;
+  // Start from what is published so skipped endpoints carry over
+  FetchResults& work = this->results_[this->front_ ^ 1];
+  work = this->results_[this->front_];
+  work.fetched = mask;
+  work.updated = work.refreshed = 0;
+  work.heap_free = work.heap_block = 0;
+  work.stack_free = 0;
+  this->work_ = &work;
+  // Released by the engine once every block in the cycle is done
+  this->running_.store(true, std::memory_order_release);
+}
 
-  BaseType_t res = xTaskCreate(&WeatherBOM::fetch_task,  // Task function
-                               "bom_fetch",              // Name
-                               6144,                     // Stack size (words)
-                               this,                     // Parameter
-                               3,                        // Priority
-                               nullptr);                 // Task handle
+// The engine has released running_: the work buffer becomes the front one and
+// publishing restarts from the first slice. A half-published older cycle is
+// simply superseded, since the new buffer holds everything it did.
+void WeatherBOM::take_results_() {
+  this->front_ ^= 1;
+  this->work_ = nullptr;
+  const FetchResults& r = this->results_[this->front_];
+  if (r.updated) {
+    this->snapshot_dirty_ = true;
+    this->data_version_++;
+  }
+  this->restored_mask_ &= ~r.refreshed;
+  this->track_failures_(r);
+#ifdef WEATHER_BOM_FETCH_OBSERVATIONS
+  // A 304 confirms the values still hold, so it fills its slot too
+  const time_t now = ::time(nullptr);
+  if (this->history_ && (r.refreshed & (1 << ENDPOINT_OBSERVATIONS)) &&
+      (r.data.valid_mask & (1 << ENDPOINT_OBSERVATIONS)) &&
+      now >= MIN_VALID_EPOCH) {
+    this->history_->add(now, r.data.obs);
+    this->history_version_++;
+  }
+#endif
+  // A search-only cycle that found no location is tried again like a failed
+  // endpoint; without a position, check_position_() starts it on a fix
+  if ((r.fetched & LOCATION_SEARCH) && this->geohash_.empty() &&
+      ((this->have_static_lat_ && this->have_static_lon_) ||
+       this->have_dynamic_)) {
+    this->set_timeout("location", this->retry_initial_ms_,
+                      [this]() { this->update(); });
+  }
+  this->publish_slice_ = 0;
+}
 
-  if (res != pdPASS) {
-    ESP_LOGE(TAG, "Failed to create bom_fetch task (err=%ld)", (long)res);
-    this->running_ = false;  // recover so future updates can try again
+// Failed endpoints are retried on a backoff timer instead of their interval;
+// after breaker_threshold_ failures in a row the circuit opens. The first
+// success resets both.
+void WeatherBOM::track_failures_(const FetchResults& r) {
+  const uint32_t now = millis();
+  for (uint8_t i = 0; i < ENDPOINT_COUNT; i++) {
+    if (!(r.fetched & (1 << i))) continue;
+    EndpointState& ep = this->endpoints_[i];
+    if (r.refreshed & (1 << i)) {
+      if (ep.failures >= this->breaker_threshold_)
+        ESP_LOGI(TAG, "%s recovered after %u failures, circuit closed",
+                 ENDPOINT_NAMES[i], ep.failures);
+      ep.failures = 0;
+      ep.retry_delay_ms = 0;
+      ep.circuit = CIRCUIT_CLOSED;
+    } else {
+      if (ep.failures < UINT8_MAX) ep.failures++;
+      ep.retry_delay_ms = this->retry_delay_ms_(ep.failures);
+      ep.next_due_ms = now + ep.retry_delay_ms;
+      if (ep.failures >= this->breaker_threshold_) {
+        if (ep.circuit == CIRCUIT_CLOSED) {
+          ep.trips++;
+          ESP_LOGW(TAG, "%s failed %u times in a row, circuit open",
+                   ENDPOINT_NAMES[i], ep.failures);
+        }
+        ep.circuit = CIRCUIT_OPEN;
+      }
+      ESP_LOGD(TAG, "%s retry in %u s", ENDPOINT_NAMES[i],
+               (unsigned)(ep.retry_delay_ms / 1000));
+    }
   }
 }
 
-// FreeRTOS task entry
-void WeatherBOM::fetch_task(void* pv) {
-  auto* self = static_cast<WeatherBOM*>(pv);
-  self->do_fetch();
-  self->running_ = false;
-  vTaskDelete(nullptr);
+// retry_initial_ms_ doubled per failure after the first, capped at
+// retry_max_ms_, then drawn from its upper half so that devices that failed
+// together do not retry together
+uint32_t WeatherBOM::retry_delay_ms_(uint8_t failures) const {
+  uint32_t delay = this->retry_initial_ms_;
+  for (uint8_t i = 1; i < failures && delay < this->retry_max_ms_; i++)
+    delay *= 2;
+  if (delay > this->retry_max_ms_) delay = this->retry_max_ms_;
+  return delay / 2 + random_uint32() % (delay / 2 + 1);
 }
 
-// Main fetch routine: fetch -> process -> free, for each endpoint in turn
-void WeatherBOM::do_fetch() {
-  if (wifi::global_wifi_component == nullptr ||
-      !wifi::global_wifi_component->is_connected()) {
-    ESP_LOGW(TAG, "WiFi lost before fetch, aborting.");
-    return;
+// One group of entities per loop() pass, so a cycle that changed everything
+// does not hold up the main loop with a few dozen state sends at once.
+// Returns false once the front buffer is fully published.
+bool WeatherBOM::publish_next_slice_() {
+  const FetchResults& r = this->results_[this->front_];
+  // A snapshot may hold endpoints this build no longer uses
+  [[maybe_unused]] const uint8_t valid =
+      r.data.valid_mask & this->enabled_mask_;
+  uint8_t published = 0;  // endpoints whose data this slice sent out
+  switch (this->publish_slice_) {
+    case SLICE_OBSERVATIONS:
+#ifdef WEATHER_BOM_FETCH_OBSERVATIONS
+      if (valid & (1 << ENDPOINT_OBSERVATIONS)) {
+        this->publish_observations_(r.data.obs);
+        published = 1 << ENDPOINT_OBSERVATIONS;
+      }
+      if (this->history_) this->publish_history_();
+#endif
+      break;
+    case SLICE_HOURLY:
+#ifdef WEATHER_BOM_FETCH_HOURLY
+      if (valid & (1 << ENDPOINT_HOURLY)) {
+        this->publish_hourly_(r.data.hourly);
+        published = 1 << ENDPOINT_HOURLY;
+      }
+#endif
+      break;
+    case SLICE_WARNINGS:
+#ifdef WEATHER_BOM_FETCH_WARNINGS
+      if (valid & (1 << ENDPOINT_WARNINGS)) {
+        this->publish_warnings_(r.data.warnings);
+        published = 1 << ENDPOINT_WARNINGS;
+      }
+#endif
+      break;
+    case SLICE_LOCATION:
+      if (r.data.geohash[0])
+        this->filter_.publish(this->out_geohash_, r.data.geohash);
+      if (r.data.location_name[0])
+        this->filter_.publish(this->location_name_, r.data.location_name);
+      break;
+    case SLICE_DIAGNOSTICS:
+      this->publish_diagnostics_(r);
+      break;
+    case SLICE_STATUS:
+      this->filter_.publish(this->data_stale_, this->restored_mask_ != 0);
+      if (r.refreshed_at != 0) this->publish_last_update_(r.refreshed_at);
+      break;
+    default:
+      if (this->publish_slice_ >= SLICE_COUNT) return false;
+#ifdef WEATHER_BOM_FETCH_FORECAST
+      // SLICE_FORECAST + day
+      if (valid & (1 << ENDPOINT_FORECAST)) {
+        const uint8_t day = this->publish_slice_ - SLICE_FORECAST;
+        this->publish_forecast_day_(r.data.days[day], day);
+        published = 1 << ENDPOINT_FORECAST;
+      }
+#endif
+      break;
   }
+  // Stamped once fetched data, not data restored at boot, has gone out
+  if ((published & r.refreshed) && this->first_data_ms_ == 0) {
+    this->first_data_ms_ = millis();
+    const uint32_t resolved = this->engine_->prewarm_resolved_ms();
+    if (resolved != 0) {
+      ESP_LOGI(TAG, "First data published %u ms after boot (API host "
+               "resolved ahead, at %u ms)",
+               (unsigned)this->first_data_ms_, (unsigned)resolved);
+    } else {
+      ESP_LOGI(TAG, "First data published %u ms after boot (no DNS warm-up)",
+               (unsigned)this->first_data_ms_);
+    }
+  }
+  this->publish_slice_++;
+  return true;
+}
 
-  bool success_any = false;
+// ---------------------------------------------------------------------------
+// Streaming handlers: pick out only the fields we publish as tokens arrive.
+// ---------------------------------------------------------------------------
+namespace {
 
-  // Resolve geohash first if needed
-  if (this->geohash_.empty()) {
-    if (!this->resolve_geohash_if_needed_()) {
-      ESP_LOGW(TAG, "Could not resolve geohash (need lat/lon)");
+// Copies a string field unless a preferred key has already filled it.
+template<size_t N>
+void take_string(char (&dst)[N], const char* value, bool preferred) {
+  if (preferred || dst[0] == '\0') json_copy_string(dst, N, value);
+}
+
+#if defined(WEATHER_BOM_FETCH_OBSERVATIONS) || \
+    defined(WEATHER_BOM_FETCH_FORECAST) || defined(WEATHER_BOM_FETCH_HOURLY)
+// A NUMBER token's value; NAN unless all of it parses (e.g. cut short)
+float parse_number(const char* value) {
+  char* end;
+  const float v = strtof(value, &end);
+  return end != value && *end == '\0' ? v : NAN;
+}
+#endif
+
+#ifdef WEATHER_BOM_FETCH_OBSERVATIONS
+// Numeric field; the fallback key only fills a value that is still unset.
+// One that does not parse counts as absent.
+void take_number(float& dst, const char* value, bool preferred) {
+  const float v = parse_number(value);
+  if (!std::isnan(v) && (preferred || std::isnan(dst))) dst = v;
+}
+#endif
+
+#ifdef WEATHER_BOM_FETCH_FORECAST
+// Same, stored as a fixed-point count of 1/scale units
+void take_fixed(int16_t& dst, const char* value, bool preferred, float scale) {
+  const float v = parse_number(value);
+  if (!std::isnan(v) && (preferred || dst == ForecastDayData::NO_VALUE))
+    dst = (int16_t)lroundf(v * scale);
+}
+#endif
+
+#if defined(WEATHER_BOM_FETCH_FORECAST) || \
+    defined(WEATHER_BOM_FETCH_HOURLY) || defined(WEATHER_BOM_FETCH_WARNINGS)
+// Days since 1970-01-01 of a proleptic Gregorian date
+int64_t days_from_civil(int y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  const int era = (y >= 0 ? y : y - 399) / 400;
+  const unsigned yoe = (unsigned)(y - era * 400);
+  const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return (int64_t)era * 146097 + (int64_t)doe - 719468;
+}
+
+// "2025-10-16T05:15:00Z" (fractional seconds and +hh:mm offsets accepted)
+// to a UTC epoch; 0 if it does not parse. Avoids timegm(), which newlib
+// lacks, and mktime(), which depends on the configured timezone.
+time_t parse_iso8601_utc(const char* s) {
+  int y, mo, d, h, mi, sec, n = 0;
+  if (sscanf(s, "%4d-%2d-%2dT%2d:%2d:%2d%n", &y, &mo, &d, &h, &mi, &sec, &n) !=
+          6 ||
+      mo < 1 || mo > 12 || d < 1 || d > 31)
+    return 0;
+  const char* p = s + n;
+  if (*p == '.')
+    while (isdigit((unsigned char)*++p)) {
+    }
+  int64_t t = days_from_civil(y, mo, d) * 86400 + h * 3600 + mi * 60 + sec;
+  int oh, om;
+  if ((*p == '+' || *p == '-') && sscanf(p + 1, "%2d:%2d", &oh, &om) == 2)
+    t -= (*p == '+' ? 1 : -1) * (oh * 3600 + om * 60);
+  return (time_t)t;
+}
+#endif
+
+// Inverse of the above, in the form BOM uses
+template<size_t N>
+const char* format_utc(time_t when, char (&buf)[N]) {
+  struct tm t;
+  gmtime_r(&when, &t);
+  strftime(buf, N, "%Y-%m-%dT%H:%M:%SZ", &t);
+  return buf;
+}
+
+#ifdef WEATHER_BOM_FETCH_OBSERVATIONS
+class ObservationsHandler : public JsonHandler {
+ public:
+  explicit ObservationsHandler(ObservationData* out) : out_(out) {}
+
+  void on_value(const JsonPath& path, JsonType type, const char* value,
+                size_t /*len*/) override {
+    if (type != JsonType::NUMBER) return;
+    if (path.matches("data/temp")) {
+      take_number(this->out_->temp, value, true);
+    } else if (path.matches("data/rain_since_9am")) {
+      take_number(this->out_->rain_since_9am, value, true);
+    } else if (path.matches("data/humidity")) {
+      take_number(this->out_->humidity, value, true);
+    } else if (path.matches("data/wind/speed_kilometre")) {
+      take_number(this->out_->wind_kmh, value, true);
+    }
+  }
+
+ protected:
+  ObservationData* out_;
+};
+#endif  // WEATHER_BOM_FETCH_OBSERVATIONS
+
+#ifdef WEATHER_BOM_FETCH_FORECAST
+struct ForecastScratch {
+  ForecastDayData days[FORECAST_DAYS];
+};
+
+class ForecastHandler : public JsonHandler {
+ public:
+  ForecastHandler(ForecastDayData* days, size_t count)
+      : days_(days), count_(count) {}
+
+  void on_value(const JsonPath& path, JsonType type, const char* value,
+                size_t /*len*/) override {
+    // data/<day>/... (older payloads use "forecast" instead of "data")
+    if (type == JsonType::STRING && path.matches("metadata/next_issue_time")) {
+      this->next_issue_time = parse_iso8601_utc(value);
+      return;
+    }
+    if (path.depth() < 3 || path.is_index(0) || !path.is_index(1)) return;
+    if (strcmp(path.key(0), "data") != 0 &&
+        strcmp(path.key(0), "forecast") != 0)
       return;
+    int idx = path.index(1);
+    if (idx < 0 || (size_t)idx >= this->count_) return;
+    ForecastDayData& day = this->days_[idx];
+
+    if (type == JsonType::NUMBER) {
+      if (path.matches("*/#/temp_min")) {
+        take_fixed(day.temp_min, value, true, 10);
+      } else if (path.matches("*/#/temperature_min")) {
+        take_fixed(day.temp_min, value, false, 10);
+      } else if (path.matches("*/#/temp_max")) {
+        take_fixed(day.temp_max, value, true, 10);
+      } else if (path.matches("*/#/temperature_max")) {
+        take_fixed(day.temp_max, value, false, 10);
+      } else if (path.matches("*/#/rain/chance")) {
+        take_fixed(day.rain_chance, value, true, 1);
+      } else if (path.matches("*/#/rain/amount/min")) {
+        take_fixed(day.rain_min, value, true, 10);
+      } else if (path.matches("*/#/rain/amount/max")) {
+        take_fixed(day.rain_max, value, true, 10);
+      }
+    } else if (type == JsonType::STRING) {
+      if (path.matches("*/#/short_text")) {
+        take_string(day.summary, value, true);
+      } else if (path.matches("*/#/summary")) {
+        take_string(day.summary, value, false);
+      } else if (path.matches("*/#/icon_descriptor")) {
+        take_string(day.icon, value, true);
+      } else if (path.matches("*/#/icon")) {
+        take_string(day.icon, value, false);
+      } else if (path.matches("*/#/astronomical/sunrise_time")) {
+        day.sunrise = parse_iso8601_utc(value);
+      } else if (path.matches("*/#/astronomical/sunset_time")) {
+        day.sunset = parse_iso8601_utc(value);
+      }
     }
   }
 
-  std::string body;
+  bool found_array() const { return this->found_array_; }
+
+  void on_container_start(const JsonPath& path, bool is_array) override {
+    if (is_array && (path.matches("data") || path.matches("forecast")))
+      this->found_array_ = true;
+  }
 
-  // ---------------------------------------------------------------------------
-  // 1) Observations
-  // ---------------------------------------------------------------------------
-  {
-    std::string url = "https://api.weather.bom.gov.au/v1/locations/" +
-                      this->geohash_ + "/observations";
+  time_t next_issue_time{0};  // metadata/next_issue_time, 0 if absent
+
+ protected:
+  ForecastDayData* days_;
+  size_t count_;
+  bool found_array_{false};
+};
+#endif  // WEATHER_BOM_FETCH_FORECAST
+
+#ifdef WEATHER_BOM_FETCH_HOURLY
+// Keeps the first `horizon` hours of /forecasts/hourly that have not ended
+// yet. Each element is decided once it closes, since "time" may come after
+// the values; the rest of the (~40 KB) body is only scanned.
+class HourlyHandler : public JsonHandler {
+ public:
+  HourlyHandler(HourlyRing* out, uint8_t horizon, time_t now)
+      : out_(out), horizon_(horizon), now_(now) {}
+
+  void on_container_start(const JsonPath& path, bool is_array) override {
+    if (!is_array && path.matches("data/#"))
+      this->hour_ = {0, HourlyData::NO_TEMP, HourlyData::NO_VALUE,
+                     HourlyData::NO_VALUE};
+  }
 
-    ESP_LOGD(TAG, "Fetching observations: %s", url.c_str());
-    if (this->fetch_url_(url, body)) {
-      this->parse_and_publish_observations_(body);
-      success_any = true;
+  void on_value(const JsonPath& path, JsonType type, const char* value,
+                size_t /*len*/) override {
+    if (type == JsonType::NUMBER) {
+      const float v = parse_number(value);
+      if (std::isnan(v)) return;
+      if (path.matches("data/#/temp")) {
+        this->hour_.temp = (int16_t)lroundf(v * 10);
+      } else if (path.matches("data/#/rain/chance")) {
+        this->hour_.rain_chance = (uint8_t)lroundf(v < 0 ? 0 : v > 100 ? 100 : v);
+      } else if (path.matches("data/#/wind/speed_kilometre")) {
+        this->hour_.wind_kmh = (uint8_t)lroundf(v < 0 ? 0 : v > 254 ? 254 : v);
+      }
+    } else if (type == JsonType::STRING && path.matches("data/#/time")) {
+      this->hour_.time = parse_iso8601_utc(value);
     }
+  }
 
-    // Free body buffer before next large fetch
-    body.clear();
-    std::string().swap(body);
+  void on_container_end(const JsonPath& path, bool is_array) override {
+    if (is_array || !path.matches("data/#") || this->hour_.time == 0) return;
+    // Without a clock, trust BOM to start at the current hour
+    if (this->now_ >= MIN_VALID_EPOCH &&
+        (time_t)this->hour_.time + 3600 <= this->now_)
+      return;
+    if (this->out_->size() < this->horizon_) this->out_->push(this->hour_);
   }
 
-  // ---------------------------------------------------------------------------
-  // 2) Daily forecast
-  // ---------------------------------------------------------------------------
-  {
-    std::string url = "https://api.weather.bom.gov.au/v1/locations/" +
-                      this->geohash_ + "/forecasts/daily";
+ protected:
+  HourlyRing* out_;
+  uint8_t horizon_;
+  time_t now_;
+  HourlyData hour_{};
+};
+#endif  // WEATHER_BOM_FETCH_HOURLY
+
+#ifdef WEATHER_BOM_FETCH_WARNINGS
+// What /warnings is parsed into: the list, and the element being read
+struct WarningsScratch {
+  WarningList list;
+  WarningData warning;
+};
+
+// Keeps each element of /warnings as a WarningData once it closes. The hash
+// runs over every key and value of the element, including those not kept.
+class WarningsHandler : public JsonHandler {
+ public:
+  explicit WarningsHandler(WarningsScratch* out)
+      : out_(&out->list), warning_(out->warning) {}
+
+  void on_container_start(const JsonPath& path, bool is_array) override {
+    if (is_array || !path.matches("data/#")) return;
+    this->warning_ = WarningData{};
+    this->hash_ = 2166136261u;
+  }
 
-    ESP_LOGD(TAG, "Fetching forecast: %s", url.c_str());
-    if (this->fetch_url_(url, body)) {
-      this->parse_and_publish_forecast_(body);
-      success_any = true;
+  void on_value(const JsonPath& path, JsonType type, const char* value,
+                size_t /*len*/) override {
+    if (path.depth() < 3 || path.is_index(0) || !path.is_index(1) ||
+        strcmp(path.key(0), "data") != 0)
+      return;
+    const uint8_t leaf = path.depth() - 1;
+    if (!path.is_index(leaf)) this->hash_update_(path.key(leaf));
+    this->hash_update_(value);
+
+    if (type != JsonType::STRING) return;
+    WarningData& w = this->warning_;
+    if (path.matches("data/#/id")) {
+      take_string(w.id, value, true);
+    } else if (path.matches("data/#/type")) {
+      take_string(w.type, value, true);
+    } else if (path.matches("data/#/title")) {
+      take_string(w.title, value, true);
+    } else if (path.matches("data/#/short_title")) {
+      take_string(w.title, value, false);
+    } else if (path.matches("data/#/phase")) {
+      take_string(w.phase, value, true);
+    } else if (path.matches("data/#/warning_group_type")) {
+      for (uint8_t i = WARNING_SEVERITY_MINOR; i <= WARNING_SEVERITY_MAJOR; i++)
+        if (strcmp(value, SEVERITY_NAMES[i]) == 0) w.severity = i;
+    } else if (path.matches("data/#/issue_time")) {
+      w.issue_time = parse_iso8601_utc(value);
+    } else if (path.matches("data/#/expiry_time")) {
+      w.expiry_time = parse_iso8601_utc(value);
     }
+  }
 
-    body.clear();
-    std::string().swap(body);
+  void on_container_end(const JsonPath& path, bool is_array) override {
+    if (is_array || !path.matches("data/#")) return;
+    this->warning_.hash = this->hash_;
+    this->out_->push(this->warning_);
   }
 
-  // ---------------------------------------------------------------------------
-  // 3) Warnings
-  // ---------------------------------------------------------------------------
-  {
-    std::string url = "https://api.weather.bom.gov.au/v1/locations/" +
-                      this->geohash_ + "/warnings";
+ protected:
+  // FNV-1a, terminator included so "ab","c" and "a","bc" differ
+  void hash_update_(const char* s) {
+    do {
+      this->hash_ ^= (uint8_t)*s;
+      this->hash_ *= 16777619u;
+    } while (*s++);
+  }
 
-    ESP_LOGD(TAG, "Fetching warnings: %s", url.c_str());
-    if (this->fetch_url_(url, body)) {
-      this->parse_and_publish_warnings_(body);
-      success_any = true;
+  WarningList* out_;
+  WarningData& warning_;
+  uint32_t hash_{0};
+};
+#endif  // WEATHER_BOM_FETCH_WARNINGS
+
+class LocationSearchHandler : public JsonHandler {
+ public:
+  void on_value(const JsonPath& path, JsonType type, const char* value,
+                size_t /*len*/) override {
+    if (type != JsonType::STRING) return;
+    if (path.matches("data/0/geohash")) {
+      this->geohash = value;
+    } else if (path.matches("data/0/name")) {
+      this->name = value;
     }
+  }
 
-    body.clear();
-    std::string().swap(body);
+  std::string geohash;
+  std::string name;
+};
+
+// A T to parse a response into before it replaces the block's copy. Like
+// the parser state, off the task stack: the TLS handshake runs on it while
+// the T is live. In the parse arena when it has room, else on the heap.
+template<typename T> T* scratch(ParseArena& arena, std::unique_ptr<T>& owned) {
+  T* p = arena.make<T>();
+  if (p == nullptr) {
+    owned = std::make_unique<T>();
+    p = owned.get();
   }
+  return p;
+}
 
-  if (success_any) {
-    this->publish_last_update_();
-  } else {
+}  // namespace
+
+// Main fetch routine: fetch + parse in one pass into *work_, for each
+// endpoint in work_->fetched, one after another over transport. Runs on the
+// worker; publishing is left to loop().
+void WeatherBOM::do_fetch(HttpTransport* transport) {
+  if (!this->snapshot_url_.empty()) {
+    this->fetch_snapshot_(transport);
+    return;
+  }
+  if (!this->begin_fetch_(transport)) return;
+  const uint8_t mask = this->work_->fetched;
+  for (uint8_t i = 0; i < ENDPOINT_COUNT; i++) {
+    const Endpoint ep = (Endpoint)i;
+    if ((mask & (1 << ep)) && !this->share_(ep))
+      this->note_result_(ep, this->fetch_endpoint_(ep, transport));
+  }
+  this->end_fetch_();
+}
+
+// Checks ahead of the block's requests; false skips them all this cycle
+bool WeatherBOM::begin_fetch_(HttpTransport* transport) {
+  if (!network::is_connected()) {
+    ESP_LOGW(TAG, "Network lost before fetch, aborting.");
+    return false;
+  }
+
+  // Resolve geohash first if needed
+  if (this->geohash_.empty()) {
+    if (!this->resolve_geohash_if_needed_(transport)) {
+      ESP_LOGW(TAG, "Could not resolve geohash (need lat/lon)");
+      return false;
+    }
+  }
+  return true;
+}
+
+// One endpoint into *work_. OK means its data was replaced; a response
+// without usable data keeps the previous data and counts as NOT_MODIFIED.
+// Endpoints touch disjoint parts of the block, so the engine may run several
+// of them at once on different connections.
+FetchResult WeatherBOM::fetch_endpoint_(Endpoint ep, HttpTransport* transport) {
+  [[maybe_unused]] FetchResults& r = *this->work_;
+  std::string url = this->api_base_url_ + "/locations/" + this->geohash_;
+  switch (ep) {
+#ifdef WEATHER_BOM_FETCH_OBSERVATIONS
+    case ENDPOINT_OBSERVATIONS: {
+      url += "/observations";
+      ESP_LOGD(TAG, "Fetching observations: %s", url.c_str());
+      ObservationData obs;
+      ObservationsHandler handler(&obs);
+      FetchResult res = this->fetch_url_(transport, url, handler, ep);
+      if (res == FetchResult::OK) {
+        ESP_LOGD(TAG, "Temperature: %f, rain since 9AM: %f", obs.temp,
+                 obs.rain_since_9am);
+        r.data.obs = obs;
+      }
+      return res;
+    }
+#endif
+
+#ifdef WEATHER_BOM_FETCH_FORECAST
+    case ENDPOINT_FORECAST: {
+      url += "/forecasts/daily";
+      ESP_LOGD(TAG, "Fetching forecast: %s", url.c_str());
+      std::unique_ptr<ForecastScratch> owned;
+      ForecastScratch* s = scratch(this->engine_->arena(), owned);
+      ForecastHandler handler(s->days, FORECAST_DAYS);
+      FetchResult res = this->fetch_url_(transport, url, handler, ep);
+      if (res == FetchResult::OK) {
+        this->forecast_next_issue_ = handler.next_issue_time;
+        if (handler.found_array()) {
+          memcpy(r.data.days, s->days, sizeof(s->days));
+        } else {
+          ESP_LOGW(TAG, "No forecast array found");
+          // Nothing kept from this body, so don't let its validators turn
+          // the next request into a 304 for it
+          this->endpoints_[ENDPOINT_FORECAST].validators = HttpValidators{};
+          res = FetchResult::NOT_MODIFIED;
+        }
+      }
+      if (res != FetchResult::FAILED) {
+        uint32_t delay_ms = this->forecast_delay_ms_();
+        this->endpoints_[ENDPOINT_FORECAST].next_due_ms = millis() + delay_ms;
+        ESP_LOGD(TAG, "Next forecast check in %u s",
+                 (unsigned)(delay_ms / 1000));
+      }
+      return res;
+    }
+#endif
+
+#ifdef WEATHER_BOM_FETCH_WARNINGS
+    case ENDPOINT_WARNINGS: {
+      url += "/warnings";
+      ESP_LOGD(TAG, "Fetching warnings: %s", url.c_str());
+      std::unique_ptr<WarningsScratch> owned;
+      WarningsScratch* s = scratch(this->engine_->arena(), owned);
+      WarningsHandler handler(s);
+      FetchResult res = this->fetch_url_(transport, url, handler, ep);
+      if (res == FetchResult::OK) {
+        if (s->list.dropped())
+          ESP_LOGW(TAG, "%u warnings beyond the first %u not kept",
+                   s->list.dropped(), WarningList::CAPACITY);
+        r.data.warnings = s->list;
+      }
+      return res;
+    }
+#endif
+
+#ifdef WEATHER_BOM_FETCH_HOURLY
+    case ENDPOINT_HOURLY: {
+      url += "/forecasts/hourly";
+      ESP_LOGD(TAG, "Fetching hourly forecast: %s", url.c_str());
+      std::unique_ptr<HourlyRing> owned;
+      HourlyRing* hourly = scratch(this->engine_->arena(), owned);
+      HourlyHandler handler(hourly, this->hourly_hours_, ::time(nullptr));
+      FetchResult res = this->fetch_url_(transport, url, handler, ep);
+      if (res == FetchResult::OK) {
+        if (hourly->size() > 0) {
+          ESP_LOGD(TAG, "Kept %u forecast hours", hourly->size());
+          r.data.hourly = *hourly;
+        } else {
+          ESP_LOGW(TAG, "No current hours in hourly forecast");
+          this->endpoints_[ENDPOINT_HOURLY].validators = HttpValidators{};
+          res = FetchResult::NOT_MODIFIED;
+        }
+      }
+      return res;
+    }
+#endif
+
+    default:
+      return FetchResult::FAILED;
+  }
+}
+
+void WeatherBOM::note_result_(Endpoint ep, FetchResult res) {
+  FetchResults& r = *this->work_;
+  if (res == FetchResult::OK) r.updated |= 1 << ep;
+  if (res != FetchResult::FAILED) r.refreshed |= 1 << ep;
+}
+
+// Once every endpoint of the block is in
+void WeatherBOM::end_fetch_() {
+  FetchResults& r = *this->work_;
+  r.handshakes_avoided = this->engine_->handshakes_avoided();
+
+  const time_t now = ::time(nullptr);
+  if (r.updated) {
+    r.data.fetched_at = now >= MIN_VALID_EPOCH ? now : 0;
+    r.data.valid_mask |= r.updated;
+  }
+  if (r.refreshed) {
+    r.refreshed_at = now;
+  } else if (r.fetched & ~LOCATION_SEARCH) {
     ESP_LOGW(TAG, "All BOM fetches failed");
   }
 }
 
-bool WeatherBOM::resolve_geohash_if_needed_() {
+// Wakes just after the next advertised forecast issue. forecast_interval
+// caps the wait (and is the fallback without issue times or a valid clock),
+// so amendments issued off-schedule are still picked up.
+uint32_t WeatherBOM::forecast_delay_ms_() const {
+  const uint32_t max_ms = this->endpoints_[ENDPOINT_FORECAST].interval_ms;
+  const time_t now = ::time(nullptr);
+  if (this->forecast_next_issue_ == 0 || now < MIN_VALID_EPOCH) return max_ms;
+
+  int64_t wait_s =
+      (int64_t)(this->forecast_next_issue_ - now) + FORECAST_ISSUE_GRACE_S;
+  // Already past it: the issue is late, and this response was the old one
+  if (wait_s < FORECAST_ISSUE_RETRY_S) wait_s = FORECAST_ISSUE_RETRY_S;
+  return (uint64_t)wait_s * 1000 < max_ms ? (uint32_t)(wait_s * 1000) : max_ms;
+}
+
+// Another block already fetched this endpoint for the same geohash this
+// cycle: take its result rather than asking BOM again
+bool WeatherBOM::share_(Endpoint ep) {
+  const WeatherBOM* src = this->engine_->fetched_by(this, ep);
+  if (src == nullptr) return false;
+  FetchResults& r = *this->work_;
+  const WeatherSnapshot& from = src->work_->data;
+  if (!this->copy_endpoint_(ep, from)) return false;
+  if (ep == ENDPOINT_FORECAST) {
+    this->forecast_next_issue_ = src->forecast_next_issue_;
+    this->endpoints_[ENDPOINT_FORECAST].next_due_ms =
+        millis() + this->forecast_delay_ms_();
+  }
+  ESP_LOGD(TAG, "%s for %s shared with another location", ENDPOINT_NAMES[ep],
+           this->geohash_.c_str());
+  r.refreshed |= 1 << ep;
+  if (from.valid_mask & (1 << ep)) r.updated |= 1 << ep;
+  return true;
+}
+
+// The data of one endpoint from another block or node into *work_
+bool WeatherBOM::copy_endpoint_(Endpoint ep, const WeatherSnapshot& from) {
+  WeatherSnapshot& to = this->work_->data;
+  switch (ep) {
+    case ENDPOINT_OBSERVATIONS:
+      to.obs = from.obs;
+      return true;
+    case ENDPOINT_FORECAST:
+      memcpy(to.days, from.days, sizeof(to.days));
+      return true;
+    case ENDPOINT_WARNINGS:
+      to.warnings = from.warnings;
+      return true;
+    case ENDPOINT_HOURLY:
+      to.hourly = from.hourly;
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Client mode: the whole snapshot of a server node, replacing the BOM
+// requests of every endpoint due this cycle. One ETag covers all of them.
+// Endpoints the server has no data for yet keep theirs, as with a 304.
+void WeatherBOM::fetch_snapshot_(HttpTransport* transport) {
+  if (!network::is_connected()) {
+    ESP_LOGW(TAG, "Network lost before fetch, aborting.");
+    return;
+  }
+  const std::string& url = this->snapshot_url_;
+  ESP_LOGD(TAG, "Fetching snapshot: %s", url.c_str());
+
+  // Like parser state, off the task stack
+  std::unique_ptr<SnapshotBlob> owned;
+  SnapshotBlob* blob = this->engine_->arena().make<SnapshotBlob>();
+  if (blob == nullptr) {
+    owned = std::make_unique<SnapshotBlob>();
+    blob = owned.get();
+  }
+  HttpValidators validators = this->snapshot_validators_;
+  size_t got = 0;
+  int status = transport->get(
+      url,
+      [&](const char* data, size_t len) {
+        if (got == 0) this->engine_->sample_heap();
+        if (len > sizeof(SnapshotBlob) - got) {
+          got = sizeof(SnapshotBlob) + 1;  // too long: not our layout
+          return false;
+        }
+        memcpy(reinterpret_cast<char*>(blob) + got, data, len);
+        got += len;
+        return true;
+      },
+      &validators);
+  this->engine_->sample_heap();
+
+  FetchResult res = FetchResult::FAILED;
+  if (status < 0) {
+    // no response
+  } else if (status == 304) {
+    ESP_LOGD(TAG, "Snapshot not modified: %s", url.c_str());
+    res = FetchResult::NOT_MODIFIED;
+  } else if (status != 200) {
+    ESP_LOGW(TAG, "Non-200 status %d for %s", status, url.c_str());
+  } else if (got != sizeof(SnapshotBlob) ||
+             blob->magic != SnapshotBlob::MAGIC ||
+             blob->version != SNAPSHOT_VERSION ||
+             blob->size != sizeof(WeatherSnapshot)) {
+    ESP_LOGW(TAG, "Snapshot from %s does not match this build's layout",
+             url.c_str());
+  } else {
+    res = FetchResult::OK;
+  }
+
+  FetchResults& r = *this->work_;
+  WeatherSnapshot& in = blob->data;
+  if (res == FetchResult::OK) {
+    this->snapshot_validators_ = std::move(validators);
+    in.geohash[sizeof(in.geohash) - 1] = '\0';
+    in.location_name[sizeof(in.location_name) - 1] = '\0';
+    json_copy_string(r.data.geohash, sizeof(r.data.geohash), in.geohash);
+    json_copy_string(r.data.location_name, sizeof(r.data.location_name),
+                     in.location_name);
+  }
+  for (uint8_t i = 0; i < ENDPOINT_COUNT; i++) {
+    const Endpoint ep = (Endpoint)i;
+    if (!(r.fetched & (1 << ep))) continue;
+    FetchResult ep_res = res;
+    if (res == FetchResult::OK &&
+        (!(in.valid_mask & (1 << ep)) || !this->copy_endpoint_(ep, in)))
+      ep_res = FetchResult::NOT_MODIFIED;
+    this->count_request_(ep, status, ep_res, transport->last_timing(), 0);
+    this->note_result_(ep, ep_res);
+  }
+  this->end_fetch_();
+  // The data is as old as the server's copy, not this request
+  if (r.updated) r.data.fetched_at = in.fetched_at;
+}
+
+// A GPS fix, from the lat or lon sensor. The first one starts the debounce
+// timer and the rest until it fires ride along, so a receiver sending both
+// coordinates every second costs one check per debounce period.
+void WeatherBOM::on_position_() {
+  this->have_dynamic_ =
+      !std::isnan(this->dynamic_lat_) && !std::isnan(this->dynamic_lon_);
+  if (!this->have_dynamic_ || this->position_pending_) return;
+  this->position_pending_ = true;
+  this->set_timeout("position", this->movement_debounce_ms_, [this]() {
+    this->position_pending_ = false;
+    this->check_position_();
+  });
+}
+
+// The location is only looked up again once the position is both
+// movement_threshold_m_ away from where it was last resolved and in another
+// cell, so GPS jitter along a cell edge does not flip it back and forth
+void WeatherBOM::check_position_() {
+  if (this->geohash_.empty()) {
+    // First fix (or the last lookup failed): fetch everything for it
+    this->update();
+    return;
+  }
+  if (this->running_.load(std::memory_order_acquire)) {
+    // geohash_ belongs to the worker until the cycle ends
+    this->on_position_();
+    return;
+  }
+
+  static constexpr float EARTH_RADIUS_M = 6371000.0f;
+  static constexpr float RAD = M_PI / 180.0f;
+  // Equirectangular; plenty for distances well under a cell's width
+  const float x = (this->dynamic_lon_ - this->last_lon_) * RAD *
+                  cosf((this->dynamic_lat_ + this->last_lat_) / 2 * RAD);
+  const float y = (this->dynamic_lat_ - this->last_lat_) * RAD;
+  const float moved_m = EARTH_RADIUS_M * sqrtf(x * x + y * y);
+  // NAN (no position known for the geohash) counts as moved
+  if (moved_m < this->movement_threshold_m_) return;
+  char cell[7];
+  geohash_encode(this->dynamic_lat_, this->dynamic_lon_, 6, cell);
+  if (strcmp(cell, this->cell_) == 0) return;
+
+  ESP_LOGI(TAG, "Moved %.0f m into cell %s (was %s), looking up the location",
+           moved_m, cell, this->cell_[0] ? this->cell_ : "unknown");
+  this->geohash_.clear();
+  this->update();
+}
+
+bool WeatherBOM::resolve_geohash_if_needed_(HttpTransport* transport) {
   float lat = NAN, lon = NAN;
 
   if (this->have_static_lat_ && this->have_static_lon_) {
@@ -235,402 +1121,709 @@ bool WeatherBOM::resolve_geohash_if_needed_() {
     return false;
   }
 
-  char q[128];
-  snprintf(q, sizeof(q),
-           "https://api.weather.bom.gov.au/v1/locations?search=%f,%f", lat,
-           lon);
-  ESP_LOGD(TAG, "Resolving geohash with URL: %s", q);
+  // BOM addresses locations by 6-character geohash cells
+  char cell[7];
+  geohash_encode(lat, lon, 6, cell);
+  memcpy(this->cell_, cell, sizeof(cell));
+  if (const auto* hit = this->engine_->locations().find(cell)) {
+    ESP_LOGD(TAG, "Cell %s cached: geohash %s (%s), skipping search", cell,
+             hit->geohash, hit->name);
+    this->use_geohash_(hit->geohash, hit->name);
+    return true;
+  }
+
+  char q[64];
+  snprintf(q, sizeof(q), "/locations?search=%f,%f", lat, lon);
+  std::string url = this->api_base_url_ + q;
+  ESP_LOGD(TAG, "Resolving geohash with URL: %s", url.c_str());
 
-  std::string resp;
-  if (!this->fetch_url_(q, resp)) {
+  LocationSearchHandler handler;
+  if (this->fetch_url_(transport, url, handler) != FetchResult::OK) {
     ESP_LOGW(TAG, "Failed to fetch geohash resolution response");
     return false;
   }
-  ESP_LOGD(TAG, "Fetched %d bytes for geohash resolution: %.100s...",
-           (int)resp.size(), resp.c_str());
-
-  cJSON* root = cJSON_ParseWithLength(resp.c_str(), resp.size());
-  if (!root) {
-    ESP_LOGW(TAG, "Failed to parse geohash JSON");
-    return false;
+  if (handler.geohash.empty()) {
+    // The cell is a valid BOM location on its own; only the name is missing.
+    // Not cached, so the search is tried again after the next reboot.
+    ESP_LOGW(TAG, "No geohash in response, using local geohash %s", cell);
+    this->use_geohash_(cell, "");
+    return true;
   }
 
-  bool ok = false;
-  cJSON* data = cJSON_GetObjectItemCaseSensitive(root, "data");
-  if (data && cJSON_IsArray(data) && cJSON_GetArraySize(data) > 0) {
-    cJSON* first = cJSON_GetArrayItem(data, 0);
-    cJSON* gh = cJSON_GetObjectItemCaseSensitive(first, "geohash");
-    cJSON* nm = cJSON_GetObjectItemCaseSensitive(first, "name");
-
-    if (cJSON_IsString(gh) && gh->valuestring != nullptr) {
-      std::string full_geohash = gh->valuestring;
-
-      // Truncate to first 6 chars for BOM compatibility
-      if (full_geohash.length() > 6) {
-        ESP_LOGW(TAG,
-                 "Geohash '%s' too long (%d). Truncating to '%s' for BOM API.",
-                 full_geohash.c_str(), (int)full_geohash.length(),
-                 full_geohash.substr(0, 6).c_str());
-        this->geohash_ = full_geohash.substr(0, 6);
-      } else {
-        this->geohash_ = full_geohash;
-      }
-
-      ok = true;
-      ESP_LOGD(TAG, "Using geohash: %s", this->geohash_.c_str());
+  std::string geohash = handler.geohash;
+  // Truncate to first 6 chars for BOM compatibility
+  if (geohash.length() > 6) {
+    ESP_LOGW(TAG,
+             "Geohash '%s' too long (%d). Truncating to '%.6s' for BOM API.",
+             geohash.c_str(), (int)geohash.length(), geohash.c_str());
+    geohash.resize(6);
+  }
+  this->engine_->locations().put(cell, geohash.c_str(), handler.name.c_str());
+  this->use_geohash_(geohash.c_str(), handler.name.c_str());
+  return true;
+}
 
-      if (this->out_geohash_) {
-        this->out_geohash_->publish_state(this->geohash_);
-      }
-    } else {
-      ESP_LOGW(TAG, "No geohash in response");
-    }
+void WeatherBOM::use_geohash_(const char* geohash, const char* name) {
+  this->geohash_ = geohash;
+  ESP_LOGD(TAG, "Using geohash: %s", geohash);
+  WeatherSnapshot& data = this->work_->data;
+  // Validators of another location's URLs say nothing about this one's
+  if (strcmp(data.geohash, geohash) != 0) {
+    for (auto& ep : this->endpoints_) ep.validators = HttpValidators{};
+  }
+  json_copy_string(data.geohash, sizeof(data.geohash), geohash);
+  // A search without a name keeps the previous one
+  if (name[0]) {
+    json_copy_string(data.location_name, sizeof(data.location_name), name);
+    ESP_LOGD(TAG, "Location name: %s", name);
+  }
 
-    // Publish location name only if available
-    if (cJSON_IsString(nm) && nm->valuestring && this->location_name_) {
-      this->location_name_->publish_state(nm->valuestring);
-      ESP_LOGD(TAG, "Location name: %s", nm->valuestring);
-    }
+  // Track the lat/lon used for this geohash to detect changes later
+  this->last_lat_ =
+      this->have_static_lat_ ? this->static_lat_ : this->dynamic_lat_;
+  this->last_lon_ =
+      this->have_static_lon_ ? this->static_lon_ : this->dynamic_lon_;
+}
 
+// Streams the response body straight into the JSON parser; nothing but the
+// transport's receive buffer and the parser's fixed state is held, whatever
+// the size. For a tracked endpoint the request is conditional, and its
+// validators are only replaced once the new body has parsed cleanly.
+FetchResult WeatherBOM::fetch_url_(HttpTransport* transport,
+                                   const std::string& url, JsonHandler& handler,
+                                   Endpoint endpoint) {
+  EndpointState* ep =
+      endpoint < ENDPOINT_COUNT ? &this->endpoints_[endpoint] : nullptr;
+  HttpValidators validators;
+  if (ep) validators = ep->validators;
+
+  // Parser state (fixed size) stays off the task stack: in the parse arena
+  // when there is one with room, else on the heap
+  std::unique_ptr<JsonStreamParser> owned;
+  JsonStreamParser* parser =
+      this->engine_->arena().make<JsonStreamParser>(&handler);
+  if (parser == nullptr) {
+    owned = std::make_unique<JsonStreamParser>(&handler);
+    parser = owned.get();
+  }
+  bool parse_failed = false;
+  uint32_t parse_us = 0;
+
+  int status = transport->get(
+      url,
+      [&](const char* data, size_t len) {
+        // Buffers are at their fullest once the body starts arriving
+        if (parser->bytes_consumed() == 0) this->engine_->sample_heap();
+        uint32_t start = micros();
+        bool ok = parser->feed(data, len);
+        parse_us += micros() - start;
+        if (ok) return true;
+        ESP_LOGW(TAG, "Malformed JSON at byte %u",
+                 (unsigned)parser->bytes_consumed());
+        parse_failed = true;
+        return false;
+      },
+      ep ? &validators : nullptr);
+  this->engine_->sample_heap();
+
+  FetchResult res = FetchResult::FAILED;
+  if (status < 0) {
+    // no response
+  } else if (status == 304 && ep) {
+    ESP_LOGD(TAG, "Not modified, skipping parse: %s", url.c_str());
+    res = FetchResult::NOT_MODIFIED;
+  } else if (status != 200) {
+    ESP_LOGW(TAG, "Non-200 status %d for %s", status, url.c_str());
+  } else if (parse_failed) {
+    ESP_LOGW(TAG, "Discarding malformed response for %s", url.c_str());
+  } else if (!parser->finish()) {
+    ESP_LOGW(TAG, "Empty or incomplete response for %s", url.c_str());
   } else {
-    ESP_LOGW(TAG, "No 'data' array or response was empty");
+    ESP_LOGD(TAG, "Parsed %u bytes (%u received) from %s in %u us",
+             (unsigned)parser->bytes_consumed(),
+             (unsigned)transport->last_timing().body_bytes, url.c_str(),
+             (unsigned)parse_us);
+    res = FetchResult::OK;
   }
 
-  cJSON_Delete(root);
-
-  if (ok) {
-    // Track the lat/lon used for this geohash to detect changes later
-    this->last_lat_ =
-        this->have_static_lat_ ? this->static_lat_ : this->dynamic_lat_;
-    this->last_lon_ =
-        this->have_static_lon_ ? this->static_lon_ : this->dynamic_lon_;
+  if (ep) {
+    this->count_request_(endpoint, status, res, transport->last_timing(),
+                         parse_us);
+    if (res == FetchResult::OK) ep->validators = std::move(validators);
   }
-  return ok;
+  return res;
 }
 
-bool WeatherBOM::fetch_url_(const std::string& url, std::string& out) {
-  // Keep BOM payloads small; cap at 8 KB to bound memory.
-  static constexpr size_t MAX_HTTP_BODY = 8192;
-
-  esp_http_client_config_t cfg = {};
-  cfg.url = url.c_str();
-  cfg.timeout_ms = 5000;
-  cfg.transport_type = HTTP_TRANSPORT_OVER_SSL;
-  cfg.crt_bundle_attach = esp_crt_bundle_attach;
-  cfg.buffer_size = 4096;
-  cfg.buffer_size_tx = 1024;
-
-  esp_http_client_handle_t client = esp_http_client_init(&cfg);
-  if (!client) {
-    ESP_LOGE(TAG, "esp_http_client_init failed for %s", url.c_str());
-    return false;
+// Counters and timing of an endpoint's request, for publish_diagnostics_()
+void WeatherBOM::count_request_(Endpoint ep, int status, FetchResult res,
+                                const HttpTiming& timing, uint32_t parse_us) {
+  EndpointStats& stats = this->work_->stats[ep];
+  if (status >= 0) {
+    stats.timing = timing;
+    stats.parse_us = parse_us;
   }
-
-  esp_err_t err = esp_http_client_set_method(client, HTTP_METHOD_GET);
-  if (err != ESP_OK) {
-    ESP_LOGE(TAG, "set_method failed: %s for %s", esp_err_to_name(err),
-             url.c_str());
-    esp_http_client_cleanup(client);
-    return false;
+  if (res == FetchResult::FAILED) {
+    stats.failures++;
+  } else {
+    stats.successes++;
   }
+  if (res == FetchResult::NOT_MODIFIED) stats.hits++;
+  if (res == FetchResult::OK) stats.misses++;
+}
 
-  err = esp_http_client_open(client, 0);
-  if (err != ESP_OK) {
-    ESP_LOGE(TAG, "open failed: %s for %s", esp_err_to_name(err), url.c_str());
-    esp_http_client_cleanup(client);
-    return false;
+// Counters and telemetry of the endpoints this cycle requested; the rest
+// have not changed since they were last published.
+void WeatherBOM::publish_diagnostics_(const FetchResults& r) {
+  if (r.fetched == 0) return;
+  auto& f = this->filter_;
+  f.publish(this->handshakes_avoided_, r.handshakes_avoided);
+  if (this->first_data_ms_ != 0)
+    f.publish(this->first_data_time_, this->first_data_ms_);
+  for (uint8_t i = 0; i < ENDPOINT_COUNT; i++) {
+    if (!(r.fetched & (1 << i))) continue;
+    const EndpointStats& st = r.stats[i];
+    EndpointState& ep = this->endpoints_[i];
+    f.publish(ep.hits_sensor, st.hits);
+    f.publish(ep.misses_sensor, st.misses);
+    sensor::Sensor** s = ep.telemetry_sensors;
+    f.publish(s[TELEMETRY_CONNECT_TIME], st.timing.connect_us / 1000.0f);
+    f.publish(s[TELEMETRY_TTFB], st.timing.ttfb_us / 1000.0f);
+    f.publish(s[TELEMETRY_DOWNLOAD_TIME], st.timing.download_us / 1000.0f);
+    f.publish(s[TELEMETRY_BYTES], st.timing.body_bytes);
+    f.publish(s[TELEMETRY_BYTES_DECODED], st.timing.decoded_bytes);
+    f.publish(s[TELEMETRY_PARSE_TIME], st.parse_us / 1000.0f);
+    f.publish(s[TELEMETRY_SUCCESSES], st.successes);
+    f.publish(s[TELEMETRY_FAILURES], st.failures);
+    f.publish(s[TELEMETRY_CONSECUTIVE_FAILURES], ep.failures);
+    f.publish(s[TELEMETRY_RETRIES], ep.retries);
+    f.publish(s[TELEMETRY_RETRY_DELAY], ep.retry_delay_ms / 1000.0f);
+    f.publish(s[TELEMETRY_BREAKER_TRIPS], ep.trips);
+    f.publish(ep.circuit_text, CIRCUIT_NAMES[ep.circuit]);
   }
-
-  int content_length = esp_http_client_fetch_headers(client);
-  int status = esp_http_client_get_status_code(client);
-  ESP_LOGD(TAG, "HTTP status: %d, content_length: %d for %s", status,
-           content_length, url.c_str());
-
-  if (status != 200) {
-    ESP_LOGW(TAG, "Non-200 status %d for %s", status, url.c_str());
-    esp_http_client_close(client);
-    esp_http_client_cleanup(client);
-    return false;
+  if (r.heap_free != 0) {
+    f.publish(this->heap_min_free_, r.heap_free);
+    f.publish(this->heap_largest_block_, r.heap_block);
+    f.publish(this->heap_block_before_, r.heap_block_before);
+    f.publish(this->heap_block_after_, r.heap_block_after);
   }
-
-  // If server claims a huge body, don't even try.
-  if (content_length > 0 && content_length > (int)MAX_HTTP_BODY) {
-    ESP_LOGW(TAG, "Content-Length %d > MAX_HTTP_BODY (%d) for %s, skipping",
-             content_length, (int)MAX_HTTP_BODY, url.c_str());
-    esp_http_client_close(client);
-    esp_http_client_cleanup(client);
-    return false;
+  if (this->engine_->arena().enabled()) {
+    f.publish(this->arena_used_, r.arena_used);
+    f.publish(this->arena_fallbacks_, r.arena_fallbacks);
   }
+  if (r.stack_free != 0) f.publish(this->task_stack_free_, r.stack_free);
 
-  out.clear();
-  out.reserve(MAX_HTTP_BODY);  // avoid repeated reallocations
-
-  char buf[1024];
-  while (true) {
-    int r = esp_http_client_read(client, buf, sizeof(buf));
-    if (r < 0) {
-      ESP_LOGE(TAG, "Read error: %d for %s", r, url.c_str());
-      break;
-    }
-    if (r == 0) break;
-
-    // Enforce cap before appending
-    size_t remaining = MAX_HTTP_BODY - out.size();
-    if (remaining == 0) {
-      ESP_LOGW(TAG, "Response reached MAX_HTTP_BODY (%d) for %s, truncating",
-               (int)MAX_HTTP_BODY, url.c_str());
-      break;
-    }
-    if ((size_t)r > remaining) r = (int)remaining;
-
-    out.append(buf, r);
+  // Last, so it includes everything held back above
+  if (this->publishes_suppressed_ &&
+      f.suppressed() != this->suppressed_published_) {
+    this->suppressed_published_ = f.suppressed();
+    this->publishes_suppressed_->publish_state(this->suppressed_published_);
   }
-
-  esp_http_client_close(client);
-  esp_http_client_cleanup(client);
-
-  bool success = !out.empty();
-  if (!success)
-    ESP_LOGW(TAG, "Empty or truncated response for %s", url.c_str());
-  return success;
 }
 
-void WeatherBOM::parse_and_publish_observations_(const std::string& json) {
-  ESP_LOGD(TAG, "Parsing observations JSON: %.100s...", json.c_str());
+#ifdef WEATHER_BOM_FETCH_OBSERVATIONS
+void WeatherBOM::publish_observations_(const ObservationData& obs) {
+  if (!std::isnan(obs.temp))
+    this->filter_.publish(this->temperature_, obs.temp);
+  if (!std::isnan(obs.rain_since_9am))
+    this->filter_.publish(this->rain_since_9am_, obs.rain_since_9am);
+  if (!std::isnan(obs.humidity))
+    this->filter_.publish(this->humidity_, obs.humidity);
+  if (!std::isnan(obs.wind_kmh))
+    this->filter_.publish(this->wind_kmh_, obs.wind_kmh);
+}
 
-  cJSON* root = cJSON_ParseWithLength(json.c_str(), json.size());
-  if (!root) {
-    ESP_LOGW(TAG, "Failed to parse observations JSON");
-    return;
+// Aggregates still unknown (e.g. no trend before 3 h of history) are left
+// unpublished rather than sent as NAN
+void WeatherBOM::publish_history_() {
+  const ObservationHistory& h = *this->history_;
+  const float values[HISTORY_STAT_COUNT] = {
+      h.temp_min(), h.temp_max(), h.temp_mean(), h.temp_trend(),
+      h.rain_rate()};
+  for (uint8_t i = 0; i < HISTORY_STAT_COUNT; i++) {
+    if (!std::isnan(values[i]))
+      this->filter_.publish(this->history_sensors_[i], values[i]);
   }
-
-  cJSON* data = cJSON_GetObjectItemCaseSensitive(root, "data");
-  if (cJSON_IsObject(data)) {
-    // Temperature
-    cJSON* temp = cJSON_GetObjectItemCaseSensitive(data, "temp");
-    if (cJSON_IsNumber(temp)) {
-      float val = (float)temp->valuedouble;
-      ESP_LOGD(TAG, "Temperature: %f", val);
-      if (this->temperature_) this->temperature_->publish_state(val);
-    }
-
-    // Rain since 9 AM
-    cJSON* rain = cJSON_GetObjectItemCaseSensitive(data, "rain_since_9am");
-    if (cJSON_IsNumber(rain)) {
-      float val = (float)rain->valuedouble;
-      ESP_LOGD(TAG, "Rain since 9AM: %f", val);
-      if (this->rain_since_9am_) this->rain_since_9am_->publish_state(val);
+}
+#endif
+
+#ifdef WEATHER_BOM_FETCH_FORECAST
+void WeatherBOM::publish_forecast_day_(const ForecastDayData& day,
+                                       uint8_t index) {
+  auto& f = this->filter_;
+  sensor::Sensor** s = this->day_sensors_[index];
+  const auto publish_fixed = [&](sensor::Sensor* sens, int16_t v, float scale) {
+    if (v != ForecastDayData::NO_VALUE) f.publish(sens, v / scale);
+  };
+  publish_fixed(s[DAY_TEMP_MIN], day.temp_min, 10);
+  publish_fixed(s[DAY_TEMP_MAX], day.temp_max, 10);
+  publish_fixed(s[DAY_RAIN_CHANCE], day.rain_chance, 1);
+  publish_fixed(s[DAY_RAIN_MIN], day.rain_min, 10);
+  publish_fixed(s[DAY_RAIN_MAX], day.rain_max, 10);
+
+  text_sensor::TextSensor** t = this->day_texts_[index];
+  if (day.summary[0]) f.publish(t[DAY_SUMMARY], day.summary);
+  if (day.icon[0]) f.publish(t[DAY_ICON], day.icon);
+  char buf[24];
+  if (day.sunrise) f.publish(t[DAY_SUNRISE], format_utc(day.sunrise, buf));
+  if (day.sunset) f.publish(t[DAY_SUNSET], format_utc(day.sunset, buf));
+}
+#endif
+
+#ifdef WEATHER_BOM_FETCH_HOURLY
+// Without a clock, hour N is simply the N-th one held
+void WeatherBOM::publish_hourly_(const HourlyRing& hourly) {
+  const time_t now = ::time(nullptr);
+  const bool have_clock = now >= MIN_VALID_EPOCH;
+  if (have_clock) this->hourly_published_hour_ = now / 3600;
+  for (const auto& hs : this->hourly_sensors_) {
+    const HourlyData* h = have_clock ? hourly.at(now + hs.hours_ahead * 3600)
+                                     : hourly.get(hs.hours_ahead);
+    float v = NAN;
+    if (h != nullptr) {
+      switch (hs.field) {
+        case HOURLY_TEMPERATURE:
+          if (h->temp != HourlyData::NO_TEMP) v = h->temp / 10.0f;
+          break;
+        case HOURLY_RAIN_CHANCE:
+          if (h->rain_chance != HourlyData::NO_VALUE) v = h->rain_chance;
+          break;
+        case HOURLY_WIND_KMH:
+          if (h->wind_kmh != HourlyData::NO_VALUE) v = h->wind_kmh;
+          break;
+      }
     }
-
-    // Humidity
-    cJSON* hum = cJSON_GetObjectItemCaseSensitive(data, "humidity");
-    if (cJSON_IsNumber(hum)) {
-      float val = (float)hum->valuedouble;
-      if (this->humidity_) this->humidity_->publish_state(val);
+    this->filter_.publish(hs.sensor, v);
+  }
+}
+#endif
+
+#ifdef WEATHER_BOM_FETCH_WARNINGS
+void WeatherBOM::publish_warnings_(const WarningList& warnings) {
+  auto& f = this->filter_;
+  f.publish(this->warnings_count_, warnings.active());
+  f.publish(this->warnings_max_severity_, warnings.max_severity());
+
+  if (this->warnings_json_) {
+    // Built from whole warnings, so a capped text still parses
+    std::string json = "[";
+    std::string item;
+    char buf[24];
+    for (uint8_t i = 0; i < warnings.size(); i++) {
+      const WarningData& w = warnings.get(i);
+      item = json.size() > 1 ? ",{\"id\":" : "{\"id\":";
+      json_append_quoted(item, w.id);
+      item += ",\"type\":";
+      json_append_quoted(item, w.type);
+      item += ",\"title\":";
+      json_append_quoted(item, w.title);
+      item += ",\"phase\":";
+      json_append_quoted(item, w.phase);
+      if (w.severity != WARNING_SEVERITY_NONE) {
+        item += ",\"warning_group_type\":";
+        json_append_quoted(item, SEVERITY_NAMES[w.severity]);
+      }
+      if (w.issue_time) {
+        item += ",\"issue_time\":";
+        json_append_quoted(item, format_utc(w.issue_time, buf));
+      }
+      if (w.expiry_time) {
+        item += ",\"expiry_time\":";
+        json_append_quoted(item, format_utc(w.expiry_time, buf));
+      }
+      item += '}';
+      if (json.size() + item.size() + 1 > MAX_WARNINGS_JSON) {
+        ESP_LOGW(TAG, "Warnings JSON full, %u of %u warnings left out",
+                 (unsigned)(warnings.size() - i), warnings.size());
+        break;
+      }
+      json += item;
     }
+    json += ']';
+    f.publish(this->warnings_json_, json.c_str());
+  }
 
-    // Wind data
-    float wind_val = NAN;
-    cJSON* wind = cJSON_GetObjectItemCaseSensitive(data, "wind");
-    if (cJSON_IsObject(wind)) {
-      cJSON* kmh = cJSON_GetObjectItemCaseSensitive(wind, "speed_kilometre");
-      if (cJSON_IsNumber(kmh)) wind_val = (float)kmh->valuedouble;
+  // A reissued or changed warning hashes differently and counts as new
+  for (uint8_t i = 0; i < warnings.size(); i++) {
+    const WarningData& w = warnings.get(i);
+    bool seen = false;
+    for (uint8_t j = 0; j < this->warning_hash_count_; j++)
+      seen |= this->warning_hashes_[j] == w.hash;
+    if (!seen) {
+      ESP_LOGI(TAG, "New warning %s (%s): %s", w.id, w.phase, w.title);
+      this->new_warning_callback_.call(w);
     }
-    if (!std::isnan(wind_val) && this->wind_kmh_)
-      this->wind_kmh_->publish_state(wind_val);
   }
-
-  cJSON_Delete(root);
+  this->remember_warnings_(warnings);
 }
+#endif
 
-// file-local helpers for forecast parsing
-static float _wb_coalesce_number(cJSON* obj, const char* k1,
-                                 const char* k2 = nullptr) {
-  if (!obj) return NAN;
-  cJSON* v = cJSON_GetObjectItemCaseSensitive(obj, k1);
-  if (cJSON_IsNumber(v)) return (float)v->valuedouble;
-  if (k2 != nullptr) {
-    v = cJSON_GetObjectItemCaseSensitive(obj, k2);
-    if (cJSON_IsNumber(v)) return (float)v->valuedouble;
-  }
-  return NAN;
+void WeatherBOM::remember_warnings_(const WarningList& warnings) {
+  this->warning_hash_count_ = warnings.size();
+  for (uint8_t i = 0; i < warnings.size(); i++)
+    this->warning_hashes_[i] = warnings.get(i).hash;
 }
 
-static std::string _wb_coalesce_string(cJSON* obj, const char* k1,
-                                       const char* k2 = nullptr) {
-  if (!obj) return {};
-  cJSON* v = cJSON_GetObjectItemCaseSensitive(obj, k1);
-  if (cJSON_IsString(v) && v->valuestring) return std::string(v->valuestring);
-  if (k2 != nullptr) {
-    v = cJSON_GetObjectItemCaseSensitive(obj, k2);
-    if (cJSON_IsString(v) && v->valuestring) return std::string(v->valuestring);
-  }
-  return {};
+void WeatherBOM::publish_last_update_(time_t when) {
+  if (!this->last_update_) return;
+
+  char buf[24];
+  this->filter_.publish(this->last_update_, format_utc(when, buf));
 }
 
-void WeatherBOM::parse_and_publish_forecast_(const std::string& json) {
-  if (json.empty()) {
-    ESP_LOGD(TAG, "No forecast JSON to parse");
+// Loads the flash snapshot into the front buffer so setup() can publish it
+// before the network is up. Entities count as stale (data_stale) until
+// their endpoint is fetched.
+void WeatherBOM::restore_snapshot_() {
+  this->snapshot_pref_ = global_preferences->make_preference<WeatherSnapshot>(
+      fnv1_hash("weather_bom_snapshot_v" + std::to_string(SNAPSHOT_VERSION) +
+                this->snapshot_key_),
+      true);
+#ifdef WEATHER_BOM_BATTERY
+  // Newer than the flash copy, and it carries the schedule on
+  if (this->deep_sleep_ != nullptr && this->restore_wake_state_()) return;
+#endif
+  FetchResults& front = this->results_[this->front_];
+  WeatherSnapshot& snap = front.data;
+  if (!this->warm_start_ || !this->snapshot_pref_.load(&snap) ||
+      snap.valid_mask == 0) {
+    snap = WeatherSnapshot{};
     return;
   }
-
-  ESP_LOGD(TAG, "Parsing forecast JSON: %.100s...", json.c_str());
-  cJSON* root = cJSON_ParseWithLength(json.c_str(), json.size());
-  if (!root) {
-    ESP_LOGW(TAG, "Failed to parse forecast JSON");
+  snap.geohash[sizeof(snap.geohash) - 1] = '\0';
+  snap.location_name[sizeof(snap.location_name) - 1] = '\0';
+
+  // Only a configured geohash pins the location this early; GPS setups show
+  // the last location's data until the first fetch
+  if (!this->geohash_.empty() && this->geohash_ != snap.geohash) {
+    ESP_LOGD(TAG, "Snapshot is for %s, not %s; ignoring", snap.geohash,
+             this->geohash_.c_str());
+    snap = WeatherSnapshot{};
     return;
   }
 
-  cJSON* arr = cJSON_GetObjectItemCaseSensitive(root, "data");
-  if (!cJSON_IsArray(arr)) {
-    arr = cJSON_GetObjectItemCaseSensitive(root, "forecast");
-    if (cJSON_IsArray(arr)) ESP_LOGD(TAG, "Using 'forecast' instead of 'data'");
+  time_t now = ::time(nullptr);
+  if (snap.fetched_at != 0 && now >= MIN_VALID_EPOCH) {
+    ESP_LOGI(TAG, "Restoring snapshot for %s, %lld s old", snap.geohash,
+             (long long)(now - snap.fetched_at));
+  } else {
+    ESP_LOGI(TAG, "Restoring snapshot for %s", snap.geohash);
   }
 
-  if (cJSON_IsArray(arr)) {
-    cJSON* day0 = cJSON_GetArrayItem(arr, 0);
-    cJSON* day1 = cJSON_GetArrayItem(arr, 1);
-
-    auto handle_day = [&](cJSON* day, bool is_today) {
-      if (!day) return;
-
-      // 1. Extract values into variables first
-      float tmin = _wb_coalesce_number(day, "temp_min", "temperature_min");
-      float tmax = _wb_coalesce_number(day, "temp_max", "temperature_max");
-
-      float rain_min = NAN;
-      float rain_max = NAN;
-      float rain_chance = NAN;
-      std::string sunrise, sunset;
-      std::string summary = _wb_coalesce_string(day, "short_text", "summary");
-      std::string icon = _wb_coalesce_string(day, "icon_descriptor", "icon");
+  front.refreshed_at = snap.fetched_at;
+  // Warnings shown before the reboot are not new
+  this->remember_warnings_(snap.warnings);
+  this->restored_mask_ = snap.valid_mask & this->enabled_mask_;
+  this->data_version_++;
+}
 
-      // Rain values
-      cJSON* rain = cJSON_GetObjectItemCaseSensitive(day, "rain");
-      if (rain) {
-        rain_chance = _wb_coalesce_number(rain, "chance");
+// Flash writes are rate-limited: a lost snapshot only costs a colder start
+void WeatherBOM::save_snapshot_if_due_() {
+  if (!this->warm_start_ || !this->snapshot_dirty_) return;
+  if (this->snapshot_saved_ms_ != 0 &&
+      millis() - this->snapshot_saved_ms_ < SNAPSHOT_SAVE_INTERVAL_MS)
+    return;
+  this->snapshot_dirty_ = false;
+  this->snapshot_saved_ms_ = millis();
+  if (!this->snapshot_pref_.save(&this->results_[this->front_].data))
+    ESP_LOGW(TAG, "Failed to save snapshot");
+}
 
-        cJSON* amount = cJSON_GetObjectItemCaseSensitive(rain, "amount");
-        if (amount) {
-          rain_min = _wb_coalesce_number(amount, "min");
-          rain_max = _wb_coalesce_number(amount, "max");
-        }
-      }
+#ifdef WEATHER_BOM_BATTERY
+// Lets the API client take the last states before the radio goes down
+static constexpr uint32_t SLEEP_SETTLE_MS = 250;
+
+// RTC slow memory is 8 KB on the ESP32, shared with deep_sleep, ULP
+// programs and other components; the wake state keeps to under a third
+static constexpr size_t WAKE_STATE_MAX = 2560;
+
+// What a battery-mode block carries through deep sleep: its data, and enough
+// of each endpoint's state to fetch only what is due on waking, conditionally.
+// Times are ::time(), which keeps counting through deep sleep whether or not
+// SNTP ever set it.
+//
+// The warnings (over half the snapshot) stay out: the flash snapshot has
+// them unless they changed since it was saved, which warnings_key tells. The
+// history keeps only its newest slots, as packed samples.
+struct WakeState {
+  static constexpr uint32_t MAGIC = 0x4b415742;  // "BWAK" in memory order
+  static constexpr uint8_t VALIDATORS = ENDPOINT_COUNT + 1;  // + snapshot_url
+  static constexpr uint32_t NEVER = UINT32_MAX;
+  static constexpr size_t DATA_SIZE = offsetof(WeatherSnapshot, warnings);
+  static constexpr uint16_t HISTORY_SLOTS = 72;
+  uint32_t crc;  // CRC-32 of everything after it
+  uint32_t magic;
+  uint32_t key;  // of the block, the snapshot layout and this struct's size
+  uint32_t slept_at;
+  char cell[7];  // and the position it was resolved at, for GPS
+  float lat, lon;
+  uint8_t scheduled;  // endpoints with a next_due
+  uint32_t next_due[ENDPOINT_COUNT];
+  uint8_t failures[ENDPOINT_COUNT];
+  // Validators that do not fit are left out; that request goes unconditional
+  char etag[VALIDATORS][64];
+  char last_modified[VALIDATORS][30];  // an HTTP-date is 29 characters
+  uint32_t forecast_next_issue;
+  uint32_t flash_saved_ago;  // s before slept_at, NEVER if not this boot
+  bool flash_dirty;
+  int64_t refreshed_at;
+  uint8_t data[DATA_SIZE];  // the WeatherSnapshot up to its warnings
+  uint32_t warnings_key;
+  // Warnings seen before the sleep, which are not new after it
+  uint32_t warning_hashes[WarningList::CAPACITY];
+  uint8_t warning_hash_count;
+  uint16_t history_len;  // of the dump, 0 without a history
+  uint8_t history[ObservationHistory::DUMP_HEADER +
+                  HISTORY_SLOTS * sizeof(ObservationSample)];
+};
+static_assert(offsetof(WeatherSnapshot, warnings) + sizeof(WarningList) ==
+                  sizeof(WeatherSnapshot),
+              "WakeState relies on the warnings ending WeatherSnapshot");
+static_assert(sizeof(WakeState) <= WAKE_STATE_MAX,
+              "WakeState outgrew its share of RTC memory");
+
+// RTC memory keeps its contents through deep sleep and software resets, and
+// holds garbage after power-on or part of a write after a brownout; the CRC
+// tells. Raw bytes, since a constructor would clear it at every boot.
+alignas(WakeState) static RTC_NOINIT_ATTR uint8_t
+    wake_state_storage[sizeof(WakeState)];
+
+static WakeState& wake_state() {
+  return *reinterpret_cast<WakeState*>(wake_state_storage);
+}
 
-      // Sunrise/Sunset
-      cJSON* astro = cJSON_GetObjectItemCaseSensitive(day, "astronomical");
-      if (astro) {
-        sunrise = _wb_coalesce_string(astro, "sunrise_time");
-        sunset = _wb_coalesce_string(astro, "sunset_time");
-      }
+static uint32_t wake_crc(const WakeState& s) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(&s);
+  return esp_rom_crc32_le(0, p + sizeof(s.crc), sizeof(s) - sizeof(s.crc));
+}
 
-      // 2. Publish grouped style
-      if (is_today) {
-        if (!std::isnan(tmin) && this->today_min_)
-          this->today_min_->publish_state(tmin);
-        if (!std::isnan(tmax) && this->today_max_)
-          this->today_max_->publish_state(tmax);
-
-        if (!std::isnan(rain_chance) && this->today_rain_chance_)
-          this->today_rain_chance_->publish_state(rain_chance);
-        if (!std::isnan(rain_min) && this->today_rain_min_)
-          this->today_rain_min_->publish_state(rain_min);
-        if (!std::isnan(rain_max) && this->today_rain_max_)
-          this->today_rain_max_->publish_state(rain_max);
-
-        if (!sunrise.empty() && this->today_sunrise_)
-          this->today_sunrise_->publish_state(sunrise);
-        if (!sunset.empty() && this->today_sunset_)
-          this->today_sunset_->publish_state(sunset);
-
-        if (!summary.empty() && this->today_summary_)
-          this->today_summary_->publish_state(summary);
-        if (!icon.empty() && this->today_icon_)
-          this->today_icon_->publish_state(icon);
-
-      } else {
-        if (!std::isnan(tmin) && this->tomorrow_min_)
-          this->tomorrow_min_->publish_state(tmin);
-        if (!std::isnan(tmax) && this->tomorrow_max_)
-          this->tomorrow_max_->publish_state(tmax);
-
-        if (!std::isnan(rain_chance) && this->tomorrow_rain_chance_)
-          this->tomorrow_rain_chance_->publish_state(rain_chance);
-        if (!std::isnan(rain_min) && this->tomorrow_rain_min_)
-          this->tomorrow_rain_min_->publish_state(rain_min);
-        if (!std::isnan(rain_max) && this->tomorrow_rain_max_)
-          this->tomorrow_rain_max_->publish_state(rain_max);
-
-        if (!sunrise.empty() && this->tomorrow_sunrise_)
-          this->tomorrow_sunrise_->publish_state(sunrise);
-        if (!sunset.empty() && this->tomorrow_sunset_)
-          this->tomorrow_sunset_->publish_state(sunset);
-
-        if (!summary.empty() && this->tomorrow_summary_)
-          this->tomorrow_summary_->publish_state(summary);
-        if (!icon.empty() && this->tomorrow_icon_)
-          this->tomorrow_icon_->publish_state(icon);
-      }
-    };
+static uint32_t warnings_key(const WarningList& warnings) {
+  uint32_t key = warnings.size() | warnings.dropped() << 8;
+  for (uint8_t i = 0; i < warnings.size(); i++)
+    key = (key ^ warnings.get(i).hash) * 16777619UL;
+  return key;
+}
 
-    handle_day(day0, true);
-    handle_day(day1, false);
+static void put_validator(char* out, size_t size, const std::string& value) {
+  if (value.size() < size) {
+    memcpy(out, value.c_str(), value.size() + 1);
   } else {
-    ESP_LOGW(TAG, "No forecast array found");
+    out[0] = '\0';
   }
-
-  cJSON_Delete(root);
 }
 
-void WeatherBOM::parse_and_publish_warnings_(const std::string& json) {
-  if (!this->warnings_json_) return;
+static std::string get_validator(const char* in, size_t size) {
+  return std::string(in, strnlen(in, size));
+}
 
-  if (json.empty()) {
-    this->warnings_json_->publish_state("[]");
-    return;
+// A wake from deep sleep: the data and schedule kept as the block went down
+// replace the flash snapshot, and only the endpoints due by now are fetched.
+// False on a cold boot, or if the clock went back, leaving it to the usual
+// warm start.
+bool WeatherBOM::restore_wake_state_() {
+  WakeState& s = wake_state();
+  const uint32_t key = fnv1_hash(this->snapshot_key_ + "_" +
+                                 std::to_string(SNAPSHOT_VERSION)) ^
+                       sizeof(WakeState);
+  if (s.magic != WakeState::MAGIC || s.key != key || s.crc != wake_crc(s))
+    return false;
+  s.magic = 0;  // taken; written again before the next sleep
+  const uint32_t now = ::time(nullptr);
+  if ((int32_t)(now - s.slept_at) < 0) {
+    ESP_LOGW(TAG, "Clock went back during sleep, starting cold");
+    return false;
   }
-
-  ESP_LOGD(TAG, "Parsing warnings JSON: %.100s...", json.c_str());
-  cJSON* root = cJSON_ParseWithLength(json.c_str(), json.size());
-  if (!root) {
-    ESP_LOGW(TAG, "Failed to parse warnings JSON, publishing empty");
-    this->warnings_json_->publish_state("[]");
-    return;
+  FetchResults& front = this->results_[this->front_];
+  WeatherSnapshot& data = front.data;
+  // The warnings from flash, if they are the ones shown before the sleep
+  if (!this->warm_start_ || !this->snapshot_pref_.load(&data))
+    data = WeatherSnapshot{};
+  const bool warnings_kept = warnings_key(data.warnings) == s.warnings_key;
+  memcpy(static_cast<void*>(&data), s.data, WakeState::DATA_SIZE);
+  data.geohash[sizeof(data.geohash) - 1] = '\0';
+  data.location_name[sizeof(data.location_name) - 1] = '\0';
+  if (!this->geohash_.empty() && data.valid_mask != 0 &&
+      this->geohash_ != data.geohash)
+    return false;
+  if (!warnings_kept) {
+    data.warnings.clear();
+    data.valid_mask &= ~(1 << ENDPOINT_WARNINGS);
+  }
+  front.refreshed_at = s.refreshed_at;
+  // Static and GPS locations skip the cell lookup too
+  if (this->geohash_.empty() && this->snapshot_url_.empty()) {
+    this->geohash_ = data.geohash;
+    s.cell[sizeof(s.cell) - 1] = '\0';
+    memcpy(this->cell_, s.cell, sizeof(s.cell));
+    this->last_lat_ = s.lat;
+    this->last_lon_ = s.lon;
   }
 
-  cJSON* data = cJSON_GetObjectItemCaseSensitive(root, "data");
-  cJSON* to_emit = data ? data : root;
+  const uint32_t ms = millis();
+  uint8_t due = 0;
+  for (uint8_t i = 0; i < ENDPOINT_COUNT; i++) {
+    EndpointState& ep = this->endpoints_[i];
+    ep.validators.etag = get_validator(s.etag[i], sizeof(s.etag[i]));
+    ep.validators.last_modified =
+        get_validator(s.last_modified[i], sizeof(s.last_modified[i]));
+    ep.failures = s.failures[i];
+    if (ep.failures >= this->breaker_threshold_) ep.circuit = CIRCUIT_OPEN;
+    if (!(s.scheduled & (1 << i))) continue;
+    if (i == ENDPOINT_WARNINGS && !warnings_kept) {
+      // A 304 would leave them blank
+      ep.validators = HttpValidators{};
+      s.next_due[i] = now;
+    }
+    const int32_t wait_s = (int32_t)(s.next_due[i] - now);
+    if (wait_s <= 0) due |= 1 << i;
+    ep.next_due_ms = ms + (wait_s > 0 ? (uint32_t)wait_s * 1000 : 0);
+  }
+  const uint8_t snap = ENDPOINT_COUNT;
+  this->snapshot_validators_.etag =
+      get_validator(s.etag[snap], sizeof(s.etag[snap]));
+  this->snapshot_validators_.last_modified =
+      get_validator(s.last_modified[snap], sizeof(s.last_modified[snap]));
+  this->forecast_next_issue_ = s.forecast_next_issue;
+  due &= this->enabled_mask_;
+  this->forced_mask_ = 0;
+  // What is not due yet is as current as it gets
+  this->restored_mask_ = due & data.valid_mask;
+
+  if (this->history_ && this->history_->load(s.history, s.history_len))
+    this->history_version_++;
+  this->snapshot_dirty_ = s.flash_dirty;
+  if (s.flash_saved_ago != WakeState::NEVER) {
+    const uint32_t ago_s = s.flash_saved_ago + (now - s.slept_at);
+    this->snapshot_saved_ms_ =
+        ms - std::min(ago_s, SNAPSHOT_SAVE_INTERVAL_MS / 1000) * 1000;
+  }
+  ESP_LOGI(TAG, "Woke %u s after going to sleep, endpoints due: 0x%02x",
+           (unsigned)(now - s.slept_at), due);
+  this->warning_hash_count_ =
+      std::min<uint8_t>(s.warning_hash_count, WarningList::CAPACITY);
+  memcpy(this->warning_hashes_, s.warning_hashes, sizeof(s.warning_hashes));
+  this->data_version_++;
+  return true;
+}
 
-  static constexpr size_t MAX_WARNINGS_JSON = 2048;
+// From the shutdown hooks, so whatever takes the device down (this block,
+// deep_sleep's own run_duration, a reboot) leaves the state behind
+void WeatherBOM::on_shutdown() {
+  if (this->deep_sleep_ != nullptr) this->save_wake_state_();
+}
 
-  char* printed = cJSON_PrintUnformatted(to_emit);
-  if (printed) {
-    size_t len = strlen(printed);
-    if (len > MAX_WARNINGS_JSON) {
-      ESP_LOGW(TAG, "Warnings JSON %u bytes > %u, truncating for publish",
-               (unsigned)len, (unsigned)MAX_WARNINGS_JSON);
-      printed[MAX_WARNINGS_JSON] = '\0';
+void WeatherBOM::save_wake_state_() {
+  WakeState& s = wake_state();
+  s.magic = 0;
+  // The worker is still writing validators; wake cold rather than torn
+  if (this->running_.load(std::memory_order_acquire)) return;
+  if (this->work_ != nullptr) this->take_results_();
+
+  const uint32_t now = ::time(nullptr);
+  const uint32_t ms = millis();
+  s.key = fnv1_hash(this->snapshot_key_ + "_" +
+                    std::to_string(SNAPSHOT_VERSION)) ^
+          sizeof(WakeState);
+  s.slept_at = now;
+  memcpy(s.cell, this->cell_, sizeof(s.cell));
+  s.lat = this->last_lat_;
+  s.lon = this->last_lon_;
+  s.scheduled = 0;
+  for (uint8_t i = 0; i < ENDPOINT_COUNT; i++) {
+    const EndpointState& ep = this->endpoints_[i];
+    put_validator(s.etag[i], sizeof(s.etag[i]), ep.validators.etag);
+    put_validator(s.last_modified[i], sizeof(s.last_modified[i]),
+                  ep.validators.last_modified);
+    s.failures[i] = ep.failures;
+    if ((this->forced_mask_ & (1 << i)) && ep.circuit == CIRCUIT_CLOSED) {
+      // Never got to it this wake
+      s.next_due[i] = now;
+    } else if (ep.interval_ms != SCHEDULER_DONT_RUN || ep.failures > 0) {
+      const int32_t wait_ms = (int32_t)(ep.next_due_ms - ms);
+      s.next_due[i] = now + (wait_ms > 0 ? (uint32_t)wait_ms / 1000 : 0);
+    } else {
+      continue;
     }
-    this->warnings_json_->publish_state(printed);
-    cJSON_free(printed);
-  } else {
-    this->warnings_json_->publish_state("[]");
+    s.scheduled |= 1 << i;
   }
-
-  cJSON_Delete(root);
+  const uint8_t snap = ENDPOINT_COUNT;
+  put_validator(s.etag[snap], sizeof(s.etag[snap]),
+                this->snapshot_validators_.etag);
+  put_validator(s.last_modified[snap], sizeof(s.last_modified[snap]),
+                this->snapshot_validators_.last_modified);
+  s.forecast_next_issue = (uint32_t)this->forecast_next_issue_;
+  s.flash_saved_ago = this->snapshot_saved_ms_ != 0
+                          ? (ms - this->snapshot_saved_ms_) / 1000
+                          : WakeState::NEVER;
+  s.flash_dirty = this->snapshot_dirty_;
+  const FetchResults& front = this->results_[this->front_];
+  s.refreshed_at = front.refreshed_at;
+  memcpy(s.data, &front.data, WakeState::DATA_SIZE);
+  s.warnings_key = warnings_key(front.data.warnings);
+  memcpy(s.warning_hashes, this->warning_hashes_, sizeof(s.warning_hashes));
+  s.warning_hash_count = this->warning_hash_count_;
+  s.history_len = this->history_ ? this->history_->dump(
+                                       s.history, sizeof(s.history),
+                                       WakeState::HISTORY_SLOTS)
+                                 : 0;
+  s.magic = WakeState::MAGIC;
+  s.crc = wake_crc(s);
 }
 
-void WeatherBOM::publish_last_update_() {
-  if (!this->last_update_) return;
+// Battery mode: sleeps until the next endpoint is due once nothing is due,
+// running or left to publish, and an API client has been there to take what
+// this wake fetched. Without network or client the device stays up until
+// deep_sleep's run_duration puts it down.
+void WeatherBOM::sleep_if_done_() {
+  const uint32_t ms = millis();
+  bool busy = this->running_.load(std::memory_order_acquire) ||
+              this->work_ != nullptr || this->requested_mask_ != 0 ||
+              this->publish_slice_ < SLICE_COUNT;
+  uint32_t sleep_ms = UINT32_MAX;
+  for (uint8_t i = 0; i < ENDPOINT_COUNT && !busy; i++) {
+    const EndpointState& ep = this->endpoints_[i];
+    if (!(this->enabled_mask_ & (1 << i))) continue;
+    // As schedule_() sees it: an open circuit waits for its timer
+    if ((this->forced_mask_ & (1 << i)) && ep.circuit == CIRCUIT_CLOSED) {
+      busy = true;
+      break;
+    }
+    if (ep.interval_ms == SCHEDULER_DONT_RUN && ep.failures == 0) continue;
+    const int32_t wait_ms = (int32_t)(ep.next_due_ms - ms);
+    if (wait_ms <= 0) {
+      busy = true;  // due, and waiting for the network
+    } else if ((uint32_t)wait_ms < sleep_ms) {
+      sleep_ms = wait_ms;
+    }
+  }
+#ifdef USE_API
+  if (this->results_[this->front_].fetched != 0 &&
+      api::global_api_server != nullptr &&
+      !api::global_api_server->is_connected())
+    busy = true;
+#endif
+  if (busy) {
+    this->sleep_at_ms_ = 0;
+    return;
+  }
+  if (this->sleep_at_ms_ == 0) {
+    this->sleep_at_ms_ = (ms + SLEEP_SETTLE_MS) | 1;
+    // The settle and shutdown hooks add a little to this
+    this->filter_.publish(this->awake_time_, ms);
+    return;
+  }
+  if ((int32_t)(ms - this->sleep_at_ms_) < 0) return;
 
-  time_t now;
-  time(&now);
-  struct tm t;
-  gmtime_r(&now, &t);
-  char buf[32];
-  strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &t);
-  this->last_update_->publish_state(buf);
+  if (sleep_ms != UINT32_MAX) {
+    ESP_LOGI(TAG, "Awake %u ms, sleeping %u s", (unsigned)ms,
+             (unsigned)(sleep_ms / 1000));
+    this->deep_sleep_->set_sleep_duration(sleep_ms);
+  } else {
+    // Nothing scheduled: deep_sleep's own sleep_duration
+    ESP_LOGI(TAG, "Awake %u ms, sleeping", (unsigned)ms);
+  }
+  this->deep_sleep_->begin_sleep(true);
 }
+#endif  // WEATHER_BOM_BATTERY
 
 }  // namespace weather_bom
 }  // namespace esphome
@@ -1,15 +1,236 @@
 #pragma once
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <ctime>
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 
+#include "esphome/components/binary_sensor/binary_sensor.h"
 #include "esphome/components/sensor/sensor.h"
 #include "esphome/components/text_sensor/text_sensor.h"
+#include "esphome/core/automation.h"
 #include "esphome/core/component.h"
+#include "esphome/core/defines.h"
+#include "esphome/core/preferences.h"
+#ifdef WEATHER_BOM_BATTERY
+#include "esphome/components/deep_sleep/deep_sleep_component.h"
+#endif
+#include "hourly_ring.h"
+#include "http_transport.h"
+#include "json_stream.h"
+#include "observation_history.h"
+#include "publish_filter.h"
+#include "warning_list.h"
 
 namespace esphome {
 namespace weather_bom {
 
+// Days kept from /forecasts/daily (BOM issues a week)
+static constexpr uint8_t FORECAST_DAYS = 7;
+
+// Fields extracted from one element of /forecasts/daily. Compact, since a
+// week of these sits in both result buffers and in the flash snapshot.
+struct ForecastDayData {
+  static constexpr int16_t NO_VALUE = INT16_MIN;
+  int16_t temp_min{NO_VALUE};  // 0.1 °C
+  int16_t temp_max{NO_VALUE};
+  int16_t rain_chance{NO_VALUE};  // %
+  int16_t rain_min{NO_VALUE};     // 0.1 mm
+  int16_t rain_max{NO_VALUE};
+  uint32_t sunrise{0};  // epoch seconds, 0 if absent
+  uint32_t sunset{0};
+  char summary[64]{};
+  char icon[24]{};
+};
+
+// Per-day forecast entities; today_* and tomorrow_* are days 0 and 1
+enum DaySensor : uint8_t {
+  DAY_TEMP_MIN = 0,
+  DAY_TEMP_MAX,
+  DAY_RAIN_CHANCE,
+  DAY_RAIN_MIN,
+  DAY_RAIN_MAX,
+  DAY_SENSOR_COUNT,
+};
+
+enum DayText : uint8_t {
+  DAY_SUMMARY = 0,
+  DAY_ICON,
+  DAY_SUNRISE,
+  DAY_SUNSET,
+  DAY_TEXT_COUNT,
+};
+
+// Aggregates over the observation history, each an optional sensor
+enum HistoryStat : uint8_t {
+  HISTORY_TEMP_MIN = 0,
+  HISTORY_TEMP_MAX,
+  HISTORY_TEMP_MEAN,
+  HISTORY_TEMP_TREND,  // °C per 3 h
+  HISTORY_RAIN_RATE,   // mm/h
+  HISTORY_STAT_COUNT,
+};
+
+// Hourly forecast entities, each for a fixed number of hours ahead
+enum HourlyField : uint8_t {
+  HOURLY_TEMPERATURE = 0,
+  HOURLY_RAIN_CHANCE,
+  HOURLY_WIND_KMH,
+};
+
+// Cap on the warnings_json text; warnings that would not fit are left out
+static constexpr size_t MAX_WARNINGS_JSON = 2048;
+
+// Layout version of WeatherSnapshot, in its preferences key and in the blob
+// served to snapshot clients; bump it when the layout changes
+static constexpr uint16_t SNAPSHOT_VERSION = 5;
+
+// Last good parsed data of every endpoint, kept in flash for warm starts.
+// Plain data so it can be stored as a preferences blob.
+struct WeatherSnapshot {
+  char geohash[8];
+  char location_name[48];
+  int64_t fetched_at;  // epoch seconds of the newest data, 0 if clock unset
+  uint8_t valid_mask;  // endpoints (1 << Endpoint) holding data
+  ObservationData obs;
+  ForecastDayData days[FORECAST_DAYS];
+  HourlyRing hourly;
+  WarningList warnings;
+};
+
+// What a snapshot server sends: the front buffer's WeatherSnapshot as is,
+// behind a header. Only a client built with the same layout (and the same
+// struct packing) takes it, which the header lets it check.
+struct SnapshotBlob {
+  static constexpr uint32_t MAGIC = 0x4d4f4257;  // "WBOM" in memory order
+  uint32_t magic;
+  uint16_t version;  // SNAPSHOT_VERSION
+  uint16_t size;     // sizeof(WeatherSnapshot)
+  WeatherSnapshot data;
+};
+
+// Per-location endpoints, each on its own schedule
+enum Endpoint : uint8_t {
+  ENDPOINT_OBSERVATIONS = 0,
+  ENDPOINT_FORECAST,
+  ENDPOINT_WARNINGS,
+  ENDPOINT_HOURLY,
+  ENDPOINT_COUNT,
+};
+
+// Endpoints built into the firmware. __init__.py defines
+// WEATHER_BOM_FETCH_<ENDPOINT> for those some block has entities for; the
+// parsing and publishing code of the others is left out.
+static constexpr uint8_t COMPILED_ENDPOINTS =
+#ifdef WEATHER_BOM_FETCH_OBSERVATIONS
+    (1 << ENDPOINT_OBSERVATIONS) |
+#endif
+#ifdef WEATHER_BOM_FETCH_FORECAST
+    (1 << ENDPOINT_FORECAST) |
+#endif
+#ifdef WEATHER_BOM_FETCH_WARNINGS
+    (1 << ENDPOINT_WARNINGS) |
+#endif
+#ifdef WEATHER_BOM_FETCH_HOURLY
+    (1 << ENDPOINT_HOURLY) |
+#endif
+    0;
+
+// Cycle bit of a block with location entities only, past the endpoint bits:
+// the cycle runs the location search and requests no endpoint
+static constexpr uint8_t LOCATION_SEARCH = 1 << ENDPOINT_COUNT;
+
+// Per-request measurements, each an optional sensor per endpoint
+enum Telemetry : uint8_t {
+  TELEMETRY_CONNECT_TIME = 0,  // ms, DNS + TCP + TLS (0 if reused)
+  TELEMETRY_TTFB,              // ms, connected to response headers
+  TELEMETRY_DOWNLOAD_TIME,     // ms, headers to end of body
+  TELEMETRY_BYTES,             // body bytes received
+  TELEMETRY_BYTES_DECODED,     // body bytes after gzip (= received if plain)
+  TELEMETRY_PARSE_TIME,        // ms spent in the JSON parser
+  TELEMETRY_SUCCESSES,         // 200/304 since boot
+  TELEMETRY_FAILURES,          // anything else since boot
+  TELEMETRY_CONSECUTIVE_FAILURES,
+  TELEMETRY_RETRIES,           // requests made after a failure, since boot
+  TELEMETRY_RETRY_DELAY,       // s, backoff after the last failure (0 if ok)
+  TELEMETRY_BREAKER_TRIPS,     // times the circuit opened, since boot
+  TELEMETRY_COUNT,
+};
+
+// Circuit breaker of an endpoint. Open after breaker_threshold failures in a
+// row: nothing but its own backoff timer may fetch it, then a single trial
+// request (half open) closes it again or reopens it.
+enum CircuitState : uint8_t {
+  CIRCUIT_CLOSED = 0,
+  CIRCUIT_OPEN,
+  CIRCUIT_HALF_OPEN,
+};
+
+// Request bookkeeping of one endpoint. Lives in FetchResults so it reaches
+// loop() together with the data.
+struct EndpointStats {
+  uint32_t hits;       // 304 Not Modified
+  uint32_t misses;     // full 200 downloads
+  uint32_t successes;  // 200/304
+  uint32_t failures;
+  HttpTiming timing;   // of the last request that got a response
+  uint32_t parse_us;
+};
+
+struct EndpointState {
+  HttpValidators validators;  // from the last body that parsed cleanly
+  sensor::Sensor *hits_sensor{nullptr};
+  sensor::Sensor *misses_sensor{nullptr};
+  sensor::Sensor *telemetry_sensors[TELEMETRY_COUNT]{};
+  text_sensor::TextSensor *circuit_text{nullptr};
+
+  uint32_t interval_ms{0};  // 0: follow update_interval
+  uint32_t next_due_ms{0};  // millis() of the next scheduled fetch
+
+  // Failure tracking, updated by loop() as results come in
+  uint8_t failures{0};  // in a row
+  CircuitState circuit{CIRCUIT_CLOSED};
+  uint32_t retry_delay_ms{0};
+  uint32_t retries{0};
+  uint32_t trips{0};
+};
+
+// Everything a fetch cycle produces for publishing. Two of these are kept:
+// loop() publishes from the front one while the worker fills the other,
+// which starts as a copy of the front so endpoints skipped this cycle keep
+// their values.
+struct FetchResults {
+  WeatherSnapshot data;
+  uint8_t fetched;       // endpoints requested this cycle
+  uint8_t updated;       // endpoints whose data changed this cycle
+  uint8_t refreshed;     // endpoints confirmed current (200 or 304)
+  int64_t refreshed_at;  // epoch of the last cycle that refreshed anything
+  EndpointStats stats[ENDPOINT_COUNT];
+  uint32_t handshakes_avoided;
+  uint32_t heap_free;  // low-water marks of the cycle, 0 if unavailable
+  uint32_t heap_block;
+  uint32_t heap_block_before;  // largest free block at the start and end
+  uint32_t heap_block_after;
+  uint32_t arena_used;         // parse arena bytes of the cycle
+  uint32_t arena_fallbacks;    // parses that did not fit, since boot
+  uint32_t stack_free;
+};
+
+enum class FetchResult : uint8_t { OK, NOT_MODIFIED, FAILED };
+
+class FetchEngine;
+class SnapshotServer;
+
+// One location and its entities. Fetching is done by the FetchEngine shared
+// by all blocks; this side schedules its endpoints and publishes results.
 class WeatherBOM : public PollingComponent {
  public:
+  void set_engine(FetchEngine *engine) { engine_ = engine; }
+  // Tells this block's flash snapshot apart from other blocks'
+  void set_snapshot_key(const std::string &key) { snapshot_key_ = key; }
   // Input setters
   void set_geohash(const std::string &g) { geohash_ = g; }
   void set_static_lat(float v) {
@@ -22,61 +243,68 @@ class WeatherBOM : public PollingComponent {
   }
   void set_lat_sensor(sensor::Sensor *s) { lat_sensor_ = s; }
   void set_lon_sensor(sensor::Sensor *s) { lon_sensor_ = s; }
+  // GPS: the location is looked up again once the position has moved at
+  // least this far from where it was last resolved, into another cell;
+  // fixes arriving within the debounce time are taken together
+  void set_movement_threshold(float meters) { movement_threshold_m_ = meters; }
+  void set_movement_debounce(uint32_t ms) { movement_debounce_ms_ = ms; }
+  void set_api_base_url(const std::string &url) { api_base_url_ = url; }
+  // Client mode: every endpoint comes from another node's snapshot server
+  // in one plain-HTTP request, instead of from BOM
+  void set_snapshot_url(const std::string &url) { snapshot_url_ = url; }
+  // Endpoints (1 << Endpoint) this block has entities for; no others are
+  // ever requested
+  void set_endpoints(uint8_t mask) { enabled_mask_ = mask; }
+  void set_warm_start(bool enabled) { warm_start_ = enabled; }
+#ifdef WEATHER_BOM_BATTERY
+  // Battery mode: state kept in RTC memory across deep sleep, and back to
+  // sleep as soon as every due endpoint is fetched and published
+  void set_deep_sleep(deep_sleep::DeepSleepComponent *d) { deep_sleep_ = d; }
+  void set_awake_time_sensor(sensor::Sensor *s) { awake_time_ = s; }
+#endif
 
   // Observations
   void set_temperature_sensor(sensor::Sensor *s) { temperature_ = s; }
   void set_humidity_sensor(sensor::Sensor *s) { humidity_ = s; }
   void set_wind_kmh_sensor(sensor::Sensor *s) { wind_kmh_ = s; }
   void set_rain_since_9am_sensor(sensor::Sensor *s) { rain_since_9am_ = s; }
-
-  // Forecast today
-  void set_today_min_sensor(sensor::Sensor *s) { today_min_ = s; }
-  void set_today_max_sensor(sensor::Sensor *s) { today_max_ = s; }
-  void set_today_rain_chance_sensor(sensor::Sensor *s) {
-    today_rain_chance_ = s;
-  }
-  void set_today_rain_min_sensor(sensor::Sensor *s) { today_rain_min_ = s; }
-  void set_today_rain_max_sensor(sensor::Sensor *s) { today_rain_max_ = s; }
-  void set_today_summary_text(text_sensor::TextSensor *t) {
-    today_summary_ = t;
-  }
-  void set_today_icon_text(text_sensor::TextSensor *t) { today_icon_ = t; }
-  void set_today_sunrise_text(text_sensor::TextSensor *s) {
-    today_sunrise_ = s;
-  }
-  void set_today_sunset_text(text_sensor::TextSensor *s) {
-    today_sunset_ = s;
+  // Observation history: one slot per interval, kept from setup() on
+  void set_history_interval(uint32_t ms) { history_interval_ms_ = ms; }
+  void set_history_sensor(HistoryStat stat, sensor::Sensor *s) {
+    history_sensors_[stat] = s;
   }
+  // For display lambdas (sparklines); nullptr without a history
+  const ObservationHistory *history() const { return history_.get(); }
 
-  // Forecast tomorrow
-  void set_tomorrow_min_sensor(sensor::Sensor *s) { tomorrow_min_ = s; }
-  void set_tomorrow_max_sensor(sensor::Sensor *s) { tomorrow_max_ = s; }
-  void set_tomorrow_rain_chance_sensor(sensor::Sensor *s) {
-    tomorrow_rain_chance_ = s;
-  }
-  void set_tomorrow_rain_min_sensor(sensor::Sensor *s) {
-    tomorrow_rain_min_ = s;
-  }
-  void set_tomorrow_rain_max_sensor(sensor::Sensor *s) {
-    tomorrow_rain_max_ = s;
+  // Forecast, any day; day 0 is today
+  void set_day_sensor(uint8_t day, DaySensor field, sensor::Sensor *s) {
+    day_sensors_[day][field] = s;
   }
-  void set_tomorrow_summary_text(text_sensor::TextSensor *t) {
-    tomorrow_summary_ = t;
+  void set_day_text_sensor(uint8_t day, DayText field,
+                           text_sensor::TextSensor *t) {
+    day_texts_[day][field] = t;
   }
-  void set_tomorrow_icon_text(text_sensor::TextSensor *t) {
-    tomorrow_icon_ = t;
-  }
-  void set_tomorrow_sunrise_text(text_sensor::TextSensor *s) {
-    tomorrow_sunrise_ = s;
-  }
-  void set_tomorrow_sunset_text(text_sensor::TextSensor *s) {
-    tomorrow_sunset_ = s;
+  // Hourly forecast: hours kept from each fetch, and "<field> in N hours"
+  void set_hourly_hours(uint8_t hours) { hourly_hours_ = hours; }
+  void add_hourly_sensor(uint8_t hours_ahead, HourlyField field,
+                         sensor::Sensor *s) {
+    hourly_sensors_.push_back({hours_ahead, field, s});
   }
 
   // Meta
   void set_warnings_json_text(text_sensor::TextSensor *t) {
     warnings_json_ = t;
   }
+  void set_warnings_count_sensor(sensor::Sensor *s) { warnings_count_ = s; }
+  void set_warnings_max_severity_sensor(sensor::Sensor *s) {
+    warnings_max_severity_ = s;
+  }
+  // Called from loop() for each warning whose content hash was not among
+  // the previously published ones
+  void add_on_new_warning_callback(
+      std::function<void(const WarningData &)> &&callback) {
+    new_warning_callback_.add(std::move(callback));
+  }
   void set_location_name_text(text_sensor::TextSensor *t) {
     location_name_ = t;
   }
@@ -84,15 +312,63 @@ class WeatherBOM : public PollingComponent {
   void set_last_update_text(text_sensor::TextSensor *t) {
     last_update_ = t;
   }
+  void set_data_stale_binary_sensor(binary_sensor::BinarySensor *b) {
+    data_stale_ = b;
+  }
+  void set_handshakes_avoided_sensor(sensor::Sensor *s) {
+    handshakes_avoided_ = s;
+  }
+  void set_task_stack_free_sensor(sensor::Sensor *s) { task_stack_free_ = s; }
+  void set_first_data_time_sensor(sensor::Sensor *s) { first_data_time_ = s; }
+  void set_publishes_suppressed_sensor(sensor::Sensor *s) {
+    publishes_suppressed_ = s;
+  }
+  void set_cache_hits_sensor(Endpoint ep, sensor::Sensor *s) {
+    endpoints_[ep].hits_sensor = s;
+  }
+  void set_cache_misses_sensor(Endpoint ep, sensor::Sensor *s) {
+    endpoints_[ep].misses_sensor = s;
+  }
+  void set_telemetry_sensor(Endpoint ep, Telemetry t, sensor::Sensor *s) {
+    endpoints_[ep].telemetry_sensors[t] = s;
+  }
+  void set_heap_min_free_sensor(sensor::Sensor *s) { heap_min_free_ = s; }
+  void set_heap_largest_block_sensor(sensor::Sensor *s) {
+    heap_largest_block_ = s;
+  }
+  void set_heap_block_before_sensor(sensor::Sensor *s) {
+    heap_block_before_ = s;
+  }
+  void set_heap_block_after_sensor(sensor::Sensor *s) {
+    heap_block_after_ = s;
+  }
+  void set_arena_used_sensor(sensor::Sensor *s) { arena_used_ = s; }
+  void set_arena_fallbacks_sensor(sensor::Sensor *s) { arena_fallbacks_ = s; }
+  void set_circuit_text_sensor(Endpoint ep, text_sensor::TextSensor *t) {
+    endpoints_[ep].circuit_text = t;
+  }
+  void set_endpoint_interval(Endpoint ep, uint32_t ms) {
+    endpoints_[ep].interval_ms = ms;
+  }
+  // Failed endpoints retry after retry_initial, doubling up to retry_max
+  // (jittered); breaker_threshold failures in a row open the circuit
+  void set_retry_initial(uint32_t ms) { retry_initial_ms_ = ms; }
+  void set_retry_max(uint32_t ms) { retry_max_ms_ = ms; }
+  void set_breaker_threshold(uint8_t n) { breaker_threshold_ = n; }
 
   void setup() override;
   void loop() override;
   void update() override;
   void dump_config() override;
+#ifdef WEATHER_BOM_BATTERY
+  void on_shutdown() override;
+#endif
 
  protected:
-  bool initial_fetch_done_ = false;
+  friend class FetchEngine;
+  friend class SnapshotServer;
 
+  FetchEngine *engine_{nullptr};
   std::string geohash_;
   bool have_static_lat_{false}, have_static_lon_{false};
   float static_lat_{0}, static_lon_{0};
@@ -101,51 +377,160 @@ class WeatherBOM : public PollingComponent {
   float dynamic_lat_{NAN}, dynamic_lon_{NAN};
   float last_lat_{NAN}, last_lon_{NAN};
   bool have_dynamic_{false};
-  bool running_{false};
+  char cell_[7]{};  // geohash cell geohash_ was resolved for
+  float movement_threshold_m_{250};
+  uint32_t movement_debounce_ms_{5000};
+  bool position_pending_{false};
+  std::atomic<bool> running_{false};
 
   // Observations
   sensor::Sensor *temperature_{nullptr};
   sensor::Sensor *humidity_{nullptr};
   sensor::Sensor *wind_kmh_{nullptr};
   sensor::Sensor *rain_since_9am_{nullptr};
+  uint32_t history_interval_ms_{0};
+  std::unique_ptr<ObservationHistory> history_;
+  uint32_t history_version_{0};  // bumped with each sample, for the server
+  sensor::Sensor *history_sensors_[HISTORY_STAT_COUNT]{};
+
+  // Forecast, indexed by day
+  sensor::Sensor *day_sensors_[FORECAST_DAYS][DAY_SENSOR_COUNT]{};
+  text_sensor::TextSensor *day_texts_[FORECAST_DAYS][DAY_TEXT_COUNT]{};
 
-  // Today forecast
-  sensor::Sensor *today_min_{nullptr};
-  sensor::Sensor *today_max_{nullptr};
-  sensor::Sensor *today_rain_chance_{nullptr};
-  sensor::Sensor *today_rain_min_{nullptr};
-  sensor::Sensor *today_rain_max_{nullptr};
-  text_sensor::TextSensor *today_summary_{nullptr};
-  text_sensor::TextSensor *today_icon_{nullptr};
-  text_sensor::TextSensor *today_sunrise_{nullptr};
-  text_sensor::TextSensor *today_sunset_{nullptr};
-
-  // Tomorrow forecast
-  sensor::Sensor *tomorrow_min_{nullptr};
-  sensor::Sensor *tomorrow_max_{nullptr};
-  sensor::Sensor *tomorrow_rain_chance_{nullptr};
-  sensor::Sensor *tomorrow_rain_min_{nullptr};
-  sensor::Sensor *tomorrow_rain_max_{nullptr};
-  text_sensor::TextSensor *tomorrow_summary_{nullptr};
-  text_sensor::TextSensor *tomorrow_icon_{nullptr};
-  text_sensor::TextSensor *tomorrow_sunrise_{nullptr};
-  text_sensor::TextSensor *tomorrow_sunset_{nullptr};
+  struct HourlySensor {
+    uint8_t hours_ahead;
+    HourlyField field;
+    sensor::Sensor *sensor;
+  };
+  std::vector<HourlySensor> hourly_sensors_;
+  uint8_t hourly_hours_{12};
+  time_t hourly_published_hour_{0};  // hour the hourly entities refer to
 
   // Meta
   text_sensor::TextSensor *warnings_json_{nullptr};
+  sensor::Sensor *warnings_count_{nullptr};
+  sensor::Sensor *warnings_max_severity_{nullptr};
+  CallbackManager<void(const WarningData &)> new_warning_callback_;
+  // Hashes of the last published warnings, to tell new ones apart
+  uint32_t warning_hashes_[WarningList::CAPACITY]{};
+  uint8_t warning_hash_count_{0};
   text_sensor::TextSensor *location_name_{nullptr};
   text_sensor::TextSensor *out_geohash_{nullptr};
   text_sensor::TextSensor *last_update_{nullptr};
+  binary_sensor::BinarySensor *data_stale_{nullptr};
+  sensor::Sensor *handshakes_avoided_{nullptr};
+  sensor::Sensor *publishes_suppressed_{nullptr};
+  sensor::Sensor *task_stack_free_{nullptr};
+  sensor::Sensor *first_data_time_{nullptr};
+  uint32_t first_data_ms_{0};  // millis() of the first fetched data published
+  sensor::Sensor *heap_min_free_{nullptr};
+  sensor::Sensor *heap_largest_block_{nullptr};
+  sensor::Sensor *heap_block_before_{nullptr};
+  sensor::Sensor *heap_block_after_{nullptr};
+  sensor::Sensor *arena_used_{nullptr};
+  sensor::Sensor *arena_fallbacks_{nullptr};
 
-  bool resolve_geohash_if_needed_();
-  bool fetch_url_(const std::string &url, std::string &out);
-  void parse_and_publish_observations_(const std::string &json);
-  void parse_and_publish_forecast_(const std::string &json);
-  void parse_and_publish_warnings_(const std::string &json);
-  void publish_last_update_();
-  void do_fetch();
+  std::string api_base_url_{"https://api.weather.bom.gov.au/v1"};
+  std::string snapshot_url_;
+  HttpValidators snapshot_validators_;
+  EndpointState endpoints_[ENDPOINT_COUNT];
+  uint32_t retry_initial_ms_{30000};
+  uint32_t retry_max_ms_{30 * 60 * 1000};
+  uint8_t breaker_threshold_{5};
+  PublishFilter filter_;
+  uint32_t suppressed_published_{0};
 
-  static void fetch_task(void *pv);
+  // Double buffer: results_[front_] belongs to loop(); work_ points at the
+  // other one while a cycle runs and is only touched by the worker until
+  // the engine releases running_.
+  FetchResults results_[2]{};
+  uint8_t front_{0};
+  FetchResults *work_{nullptr};
+  enum PublishSlice : uint8_t {
+    SLICE_OBSERVATIONS,
+    SLICE_FORECAST,  // one slice per day
+    SLICE_HOURLY = SLICE_FORECAST + FORECAST_DAYS,
+    SLICE_WARNINGS,
+    SLICE_LOCATION,
+    SLICE_DIAGNOSTICS,
+    SLICE_STATUS,
+    SLICE_COUNT,
+  };
+  uint8_t publish_slice_{SLICE_COUNT};  // next slice of the front buffer
+  // Bumped whenever the front buffer's data changes, for the snapshot server
+  uint32_t data_version_{0};
+
+  // Warm start: the front buffer's data is written to flash from loop();
+  // restored_mask_ holds endpoints still showing restored data
+  bool warm_start_{true};
+  std::string snapshot_key_;
+  ESPPreferenceObject snapshot_pref_;
+  bool snapshot_dirty_{false};
+  uint32_t snapshot_saved_ms_{0};
+  uint8_t restored_mask_{0};
+  // Endpoints (1 << Endpoint) with entities to feed (and compiled in), those
+  // requested by update() regardless of schedule, and those waiting for the
+  // engine; LOCATION_SEARCH instead for a block with location entities only
+  uint8_t enabled_mask_{0};
+  uint8_t forced_mask_{0};
+  uint8_t requested_mask_{0};
+  time_t forecast_next_issue_{0};  // from the last forecast body, 0 if unknown
+
+#ifdef WEATHER_BOM_BATTERY
+  deep_sleep::DeepSleepComponent *deep_sleep_{nullptr};
+  sensor::Sensor *awake_time_{nullptr};
+  // millis() after which to sleep, once everything is done; 0 while not
+  uint32_t sleep_at_ms_{0};
+
+  bool restore_wake_state_();
+  void save_wake_state_();
+  void sleep_if_done_();
+#endif
+
+  void schedule_();
+  void begin_cycle_(uint8_t mask);
+  bool share_(Endpoint ep);
+  uint32_t forecast_delay_ms_() const;
+  void on_position_();
+  void check_position_();
+  bool resolve_geohash_if_needed_(HttpTransport *transport);
+  void use_geohash_(const char *geohash, const char *name);
+  bool copy_endpoint_(Endpoint ep, const WeatherSnapshot &from);
+  FetchResult fetch_url_(HttpTransport *transport, const std::string &url,
+                         JsonHandler &handler,
+                         Endpoint endpoint = ENDPOINT_COUNT);
+  void count_request_(Endpoint ep, int status, FetchResult res,
+                      const HttpTiming &timing, uint32_t parse_us);
+  void take_results_();
+  void track_failures_(const FetchResults &r);
+  uint32_t retry_delay_ms_(uint8_t failures) const;
+  bool publish_next_slice_();
+  void publish_observations_(const ObservationData &obs);
+  void publish_history_();
+  void publish_forecast_day_(const ForecastDayData &day, uint8_t index);
+  void publish_hourly_(const HourlyRing &hourly);
+  void publish_warnings_(const WarningList &warnings);
+  void remember_warnings_(const WarningList &warnings);
+  void publish_diagnostics_(const FetchResults &r);
+  void publish_last_update_(time_t when);
+  void restore_snapshot_();
+  void save_snapshot_if_due_();
+  // Worker side. do_fetch() runs the whole block on one connection; the
+  // engine may instead call the steps itself to spread endpoints over several.
+  void do_fetch(HttpTransport *transport);
+  bool begin_fetch_(HttpTransport *transport);
+  void fetch_snapshot_(HttpTransport *transport);
+  FetchResult fetch_endpoint_(Endpoint ep, HttpTransport *transport);
+  void note_result_(Endpoint ep, FetchResult res);
+  void end_fetch_();
+};
+
+class NewWarningTrigger : public Trigger<const WarningData &> {
+ public:
+  explicit NewWarningTrigger(WeatherBOM *parent) {
+    parent->add_on_new_warning_callback(
+        [this](const WarningData &w) { this->trigger(w); });
+  }
 };
 
 }  // namespace weather_bom
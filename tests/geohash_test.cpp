@@ -0,0 +1,83 @@
+#include "geohash.h"
+
+#include <cstring>
+
+#include "test.h"
+
+using namespace esphome::weather_bom;
+
+namespace {
+
+// Known cells, the first two from the geohash reference examples
+void test_known() {
+  char out[12];
+  geohash_encode(57.64911, 10.40744, 11, out);
+  CHECK_STR(out, "u4pruydqqvj");
+  geohash_encode(42.6, -5.6, 5, out);
+  CHECK_STR(out, "ezs42");
+  geohash_encode(-37.8136, 144.9631, 7, out);  // Melbourne
+  CHECK_STR(out, "r1r0fsn");
+  geohash_encode(-33.8688, 151.2093, 6, out);  // Sydney
+  CHECK_STR(out, "r3gx2f");
+  geohash_encode(-12.4634, 130.8456, 6, out);  // Darwin
+  CHECK_STR(out, "qvv117");
+}
+
+// The corners and the origin; an edge belongs to the cell above it
+void test_edges() {
+  char out[7];
+  geohash_encode(0, 0, 6, out);
+  CHECK_STR(out, "s00000");
+  geohash_encode(90, 180, 6, out);
+  CHECK_STR(out, "zzzzzz");
+  geohash_encode(-90, -180, 6, out);
+  CHECK_STR(out, "000000");
+  geohash_encode(-1e-9, -1e-9, 6, out);
+  CHECK_STR(out, "7zzzzz");
+}
+
+// A shorter hash is a prefix of a longer one; the terminator is written
+void test_precision() {
+  char longer[13], shorter[13];
+  memset(shorter, 'x', sizeof(shorter));
+  geohash_encode(-37.8136, 144.9631, 12, longer);
+  for (size_t n = 0; n <= 12; n++) {
+    geohash_encode(-37.8136, 144.9631, n, shorter);
+    CHECK_EQ(strlen(shorter), n);
+    CHECK(strncmp(shorter, longer, n) == 0);
+  }
+}
+
+// A 6-character cell is 360 / 2^15 degrees of longitude wide (~1.1 km)
+// and 180 / 2^15 degrees of latitude high; either side of an edge are
+// neighbouring cells, and points inside one share it
+void test_cells() {
+  const double lon_step = 360.0 / (1 << 15), lat_step = 180.0 / (1 << 15);
+  // Cell edges near Melbourne
+  const double lon_edge = -180 + 29583 * lon_step;
+  const double lat_edge = -90 + 9500 * lat_step;
+  char a[7], b[7];
+  geohash_encode(-37.81, lon_edge - 1e-7, 6, a);
+  geohash_encode(-37.81, lon_edge + 1e-7, 6, b);
+  CHECK(strcmp(a, b) != 0);
+  geohash_encode(-37.81, lon_edge + 1e-7, 6, a);
+  geohash_encode(-37.81, lon_edge + lon_step - 1e-7, 6, b);
+  CHECK_STR(a, b);
+
+  geohash_encode(lat_edge - 1e-7, 144.96, 6, a);
+  geohash_encode(lat_edge + 1e-7, 144.96, 6, b);
+  CHECK(strcmp(a, b) != 0);
+  geohash_encode(lat_edge + 1e-7, 144.96, 6, a);
+  geohash_encode(lat_edge + lat_step - 1e-7, 144.96, 6, b);
+  CHECK_STR(a, b);
+}
+
+}  // namespace
+
+int main() {
+  test_known();
+  test_edges();
+  test_precision();
+  test_cells();
+  return test_result();
+}
@@ -0,0 +1,161 @@
+#include "gzip_stream.h"
+
+#include <zlib.h>
+
+#include <string>
+
+#include "test.h"
+
+using namespace esphome::weather_bom;
+
+namespace {
+
+// src as a gzip member from zlib, with header fields when given
+std::string gzip(const std::string& src, gz_header* header = nullptr) {
+  z_stream zs{};
+  deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 9,
+               Z_DEFAULT_STRATEGY);
+  if (header != nullptr) deflateSetHeader(&zs, header);
+  std::string out(deflateBound(&zs, src.size()) + 64, '\0');
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(src.data()));
+  zs.avail_in = (uInt)src.size();
+  zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  zs.avail_out = (uInt)out.size();
+  deflate(&zs, Z_FINISH);
+  out.resize(zs.total_out);
+  deflateEnd(&zs);
+  return out;
+}
+
+// JSON-like text well past the 32 KB window, with matches near and far
+std::string sample(size_t size) {
+  std::string s = "{\"data\":[";
+  uint32_t x = 12345;
+  while (s.size() < size) {
+    x = x * 1103515245 + 12345;
+    s += "{\"temp\":" + std::to_string(x % 400) + ",\"rain\":{\"chance\":" +
+         std::to_string((x >> 8) % 100) + "},\"id\":\"" +
+         std::to_string(x) + "\"},";
+  }
+  return s + "{}]}";
+}
+
+// in fed to gz in chunks of chunk bytes (0 = at once); what it decoded, or
+// "!" if it failed or did not reach the end
+std::string inflate(GzipStream& gz, const std::string& in, size_t chunk = 0) {
+  std::string out;
+  const auto sink = [&out](const char* data, size_t len) {
+    out.append(data, len);
+    return true;
+  };
+  gz.begin();
+  if (chunk == 0) chunk = in.size() > 0 ? in.size() : 1;
+  for (size_t i = 0; i < in.size(); i += chunk) {
+    const size_t n = in.size() - i < chunk ? in.size() - i : chunk;
+    if (!gz.feed(in.data() + i, n, sink)) return "!";
+  }
+  return gz.done() ? out : "!";
+}
+
+void test_round_trip() {
+  GzipStream gz;
+  CHECK(gz.init());
+  const std::string text = sample(100000);
+  const std::string packed = gzip(text);
+  CHECK(packed.size() < text.size() / 3);
+  CHECK(inflate(gz, packed) == text);
+  CHECK_EQ(gz.decoded(), text.size());
+  // Any chunking; the same stream serves one body after another
+  for (size_t chunk : {1, 7, 512, 4096})
+    CHECK(inflate(gz, packed, chunk) == text);
+  CHECK_EQ(inflate(gz, gzip("")), "");
+  CHECK_EQ(inflate(gz, gzip("x")), "x");
+}
+
+// FEXTRA, FNAME, FCOMMENT and FHCRC are skipped, each across chunks
+void test_header_fields() {
+  GzipStream gz;
+  CHECK(gz.init());
+  unsigned char extra[] = "AB\x04\x00data";
+  gz_header header{};
+  header.extra = extra;
+  header.extra_len = sizeof(extra) - 1;
+  header.name = reinterpret_cast<Bytef*>(const_cast<char*>("obs.json"));
+  header.comment = reinterpret_cast<Bytef*>(const_cast<char*>("comment"));
+  header.hcrc = 1;
+  const std::string packed = gzip("{\"a\":1}", &header);
+  CHECK_EQ(packed[3] & 0x1E, 0x1E);
+  CHECK_EQ(inflate(gz, packed), "{\"a\":1}");
+  CHECK_EQ(inflate(gz, packed, 1), "{\"a\":1}");
+}
+
+void test_malformed() {
+  GzipStream gz;
+  CHECK(gz.init());
+  const std::string good = gzip("{\"a\":[1,2,3]}");
+  std::string bad = good;
+  bad[0] = 0x1E;  // ID1
+  CHECK_EQ(inflate(gz, bad), "!");
+  CHECK(gz.failed());
+  bad = good;
+  bad[2] = 7;  // not deflate
+  CHECK_EQ(inflate(gz, bad), "!");
+  bad = good;
+  bad[3] = 0x20;  // reserved flag
+  CHECK_EQ(inflate(gz, bad), "!");
+  bad = good;
+  bad[10] = (char)0xFF;  // reserved block type
+  CHECK_EQ(inflate(gz, bad), "!");
+  bad = good;
+  bad[bad.size() - 4]++;  // ISIZE
+  CHECK_EQ(inflate(gz, bad), "!");
+  // A failure sticks until the next begin()
+  CHECK(!gz.feed("x", 1, [](const char*, size_t) { return true; }));
+  CHECK_EQ(inflate(gz, good), "{\"a\":[1,2,3]}");
+  // Cut short: not failed, but not done either
+  CHECK_EQ(inflate(gz, good.substr(0, good.size() - 3)), "!");
+  CHECK(!gz.failed());
+}
+
+void test_after_end() {
+  GzipStream gz;
+  CHECK(gz.init());
+  // Anything after the first member is ignored
+  CHECK_EQ(inflate(gz, gzip("one") + gzip("two")), "one");
+  CHECK_EQ(inflate(gz, gzip("one") + "garbage"), "one");
+}
+
+// A sink returning false stops decoding
+void test_sink_stops() {
+  GzipStream gz;
+  CHECK(gz.init());
+  const std::string packed = gzip(sample(20000));
+  size_t calls = 0;
+  gz.begin();
+  CHECK(!gz.feed(packed.data(), packed.size(), [&calls](const char*, size_t) {
+    calls++;
+    return false;
+  }));
+  CHECK_EQ(calls, 1u);
+  CHECK(!gz.done());
+}
+
+// Without init() there is nothing to decode with
+void test_no_init() {
+  GzipStream gz;
+  gz.begin();
+  CHECK(gz.failed());
+  CHECK(!gz.feed("\x1f", 1, [](const char*, size_t) { return true; }));
+}
+
+}  // namespace
+
+int main() {
+  test_round_trip();
+  test_header_fields();
+  test_malformed();
+  test_after_end();
+  test_sink_stops();
+  test_no_init();
+  return test_result();
+}
@@ -0,0 +1,96 @@
+#include "hourly_ring.h"
+
+#include <type_traits>
+
+#include "test.h"
+
+using namespace esphome::weather_bom;
+
+namespace {
+
+constexpr uint32_t T0 = 1760000400;  // on the hour
+constexpr uint32_t HOUR = 3600;
+
+HourlyData hour(uint32_t n) {
+  return HourlyData{T0 + n * HOUR, (int16_t)(n * 10), (uint8_t)n, 5};
+}
+
+// Kept in the flash snapshot and copied between result buffers as bytes
+static_assert(std::is_trivially_copyable<HourlyRing>::value, "plain data");
+static_assert(sizeof(HourlyData) == 8, "packed into 8 bytes");
+
+void test_push_get() {
+  HourlyRing ring;
+  CHECK_EQ(ring.size(), 0);
+  CHECK(ring.get(0) == nullptr);
+  for (uint32_t n = 0; n < 3; n++) ring.push(hour(n));
+  CHECK_EQ(ring.size(), 3);
+  for (uint8_t i = 0; i < 3; i++) CHECK_EQ(ring.get(i)->time, T0 + i * HOUR);
+  CHECK(ring.get(3) == nullptr);
+  ring.clear();
+  CHECK_EQ(ring.size(), 0);
+  CHECK(ring.at(T0) == nullptr);
+}
+
+// Once full, each push overwrites the oldest hour
+void test_wrap() {
+  HourlyRing ring;
+  const uint32_t total = HourlyRing::CAPACITY + 10;
+  for (uint32_t n = 0; n < total; n++) ring.push(hour(n));
+  CHECK_EQ(ring.size(), HourlyRing::CAPACITY);
+  CHECK_EQ(ring.get(0)->time, T0 + 10 * HOUR);
+  CHECK_EQ(ring.get(HourlyRing::CAPACITY - 1)->time, T0 + (total - 1) * HOUR);
+  for (uint8_t i = 1; i < ring.size(); i++)
+    CHECK_EQ(ring.get(i)->time - ring.get(i - 1)->time, HOUR);
+}
+
+// An hour is dropped once it has ended, not when it starts
+void test_drop_before() {
+  HourlyRing ring;
+  for (uint32_t n = 0; n < 5; n++) ring.push(hour(n));
+  ring.drop_before(T0 + HOUR - 1);
+  CHECK_EQ(ring.size(), 5);
+  ring.drop_before(T0 + HOUR);
+  CHECK_EQ(ring.size(), 4);
+  CHECK_EQ(ring.get(0)->time, T0 + HOUR);
+  ring.drop_before(T0 + 3 * HOUR + 1800);
+  CHECK_EQ(ring.size(), 2);
+  CHECK_EQ(ring.get(0)->temp, 30);
+  ring.drop_before(T0 + 10 * HOUR);
+  CHECK_EQ(ring.size(), 0);
+  // Still usable after emptying, from any position in the array
+  ring.push(hour(20));
+  CHECK_EQ(ring.size(), 1);
+  CHECK_EQ(ring.get(0)->time, T0 + 20 * HOUR);
+}
+
+void test_drop_after_wrap() {
+  HourlyRing ring;
+  for (uint32_t n = 0; n < HourlyRing::CAPACITY + 5; n++) ring.push(hour(n));
+  ring.drop_before(T0 + (HourlyRing::CAPACITY + 2) * HOUR);
+  CHECK_EQ(ring.size(), 3);
+  CHECK_EQ(ring.get(0)->time, T0 + (HourlyRing::CAPACITY + 2) * HOUR);
+  CHECK(ring.get(3) == nullptr);
+}
+
+void test_at() {
+  HourlyRing ring;
+  for (uint32_t n = 0; n < 4; n++) ring.push(hour(n));
+  CHECK(ring.at(T0 - 1) == nullptr);
+  CHECK_EQ(ring.at(T0)->rain_chance, 0);
+  CHECK_EQ(ring.at(T0 + HOUR - 1)->rain_chance, 0);
+  CHECK_EQ(ring.at(T0 + HOUR)->rain_chance, 1);
+  CHECK_EQ(ring.at(T0 + 3 * HOUR + 1)->rain_chance, 3);
+  CHECK(ring.at(T0 + 4 * HOUR) == nullptr);
+}
+
+}  // namespace
+
+int main() {
+  test_push_get();
+  test_wrap();
+  test_drop_before();
+  test_drop_after_wrap();
+  test_at();
+  return test_result();
+}
@@ -0,0 +1,4 @@
+#pragma once
+// Stands in for the defines.h ESPHome generates, with the component options
+// whose code the host tests cover
+#define WEATHER_BOM_GZIP
@@ -0,0 +1,238 @@
+#include "json_stream.h"
+
+#include <algorithm>
+#include <string>
+
+#include "test.h"
+
+using namespace esphome::weather_bom;
+
+namespace {
+
+// Each event as one line: "[" / "{" and "]" / "}" with the container's
+// path, or path=value with S, N, B or Z for the type
+class Recorder : public JsonHandler {
+ public:
+  void on_container_start(const JsonPath& path, bool is_array) override {
+    this->events += (is_array ? "[ " : "{ ") + str(path) + "\n";
+  }
+  void on_container_end(const JsonPath& path, bool is_array) override {
+    this->events += (is_array ? "] " : "} ") + str(path) + "\n";
+  }
+  void on_value(const JsonPath& path, JsonType type, const char* value,
+                size_t len) override {
+    static const char TYPES[] = "SNBZ";
+    this->events += str(path) + "=" + TYPES[(int)type] + ":" +
+                    std::string(value, len) + "\n";
+    this->last.assign(value, len);
+    if (path.matches("data/#/name")) this->names++;
+  }
+
+  static std::string str(const JsonPath& path) {
+    std::string s;
+    for (uint8_t i = 0; i < path.depth(); i++) {
+      if (i) s += '/';
+      s += path.is_index(i) ? std::to_string(path.index(i)) : path.key(i);
+    }
+    return s;
+  }
+
+  std::string events;
+  std::string last;  // the last value
+  int names{0};
+};
+
+// The whole document in chunks of chunk bytes (0 = at once); false if it
+// is rejected
+bool parse(const std::string& doc, Recorder& rec, size_t chunk = 0) {
+  JsonStreamParser parser(&rec);
+  if (chunk == 0) chunk = doc.size();
+  for (size_t i = 0; i < doc.size(); i += chunk) {
+    if (!parser.feed(doc.data() + i, std::min(chunk, doc.size() - i)))
+      return false;
+  }
+  return parser.finish();
+}
+
+bool valid(const char* doc) {
+  Recorder rec;
+  return parse(doc, rec);
+}
+
+// The last value in doc, "!" if it is rejected
+std::string scalar(const char* doc) {
+  Recorder rec;
+  return parse(doc, rec) ? rec.last : "!";
+}
+
+void test_events() {
+  Recorder rec;
+  CHECK(parse(R"({"data":[{"name":"Melbourne","n":-1.5e2},
+                 {"name":"x","ok":true,"no":null}],"n":0})",
+              rec));
+  CHECK_EQ(rec.events,
+           "{ \n"
+           "[ data\n"
+           "{ data/0\n"
+           "data/0/name=S:Melbourne\n"
+           "data/0/n=N:-1.5e2\n"
+           "} data/0\n"
+           "{ data/1\n"
+           "data/1/name=S:x\n"
+           "data/1/ok=B:true\n"
+           "data/1/no=Z:null\n"
+           "} data/1\n"
+           "] data\n"
+           "n=N:0\n"
+           "} \n");
+  CHECK_EQ(rec.names, 2);
+}
+
+// Any split of the input gives the same events
+void test_chunks() {
+  const std::string doc =
+      R"({"a":[1,22.5,-3e+1,"\u00e9\ud83c\udf27",false],"b":{"c":"d\n"}})";
+  Recorder whole;
+  CHECK(parse(doc, whole));
+  for (size_t chunk = 1; chunk < 8; chunk++) {
+    Recorder rec;
+    CHECK(parse(doc, rec, chunk));
+    CHECK_EQ(rec.events, whole.events);
+  }
+}
+
+void test_matches() {
+  struct Matcher : JsonHandler {
+    void on_value(const JsonPath& path, JsonType, const char*,
+                  size_t) override {
+      this->exact = path.matches("data/2/rain/chance");
+      this->any_index = path.matches("data/#/rain/chance");
+      this->any_segment = path.matches("*/*/rain/*");
+      this->wrong_index = path.matches("data/1/rain/chance");
+      this->key_for_index = path.matches("data/rain/rain/chance");
+      this->too_short = path.matches("data/#/rain");
+      this->too_long = path.matches("data/#/rain/chance/x");
+    }
+    bool exact{false}, any_index{false}, any_segment{false};
+    bool wrong_index{true}, key_for_index{true}, too_short{true},
+        too_long{true};
+  } m;
+  JsonStreamParser parser(&m);
+  const char doc[] = R"({"data":[0,0,{"rain":{"chance":40}}]})";
+  CHECK(parser.feed(doc, sizeof(doc) - 1));
+  CHECK(parser.finish());
+  CHECK(m.exact);
+  CHECK(m.any_index);
+  CHECK(m.any_segment);
+  CHECK(!m.wrong_index);
+  CHECK(!m.key_for_index);
+  CHECK(!m.too_short);
+  CHECK(!m.too_long);
+}
+
+// RFC 8259: -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+void test_numbers() {
+  for (const char* doc : {"0", "-0", "[0]", "[-0.5]", "[10]", "[0e5]",
+                          "[1E-7]", "[12.50e+03]", "1.5", "[1 ,2]"})
+    CHECK(valid(doc));
+  for (const char* doc : {"00", "[01]", "[-01]", "-", "[-]", "[1-2]",
+                          "[1..2]", "[1e]", "1e", "[1.]", "[.5]", "[1e+]",
+                          "[+1]", "[1e5.0]", "[0x10]", "[-a]"})
+    CHECK(!valid(doc));
+  CHECK_EQ(scalar("[12.50e+03]"), "12.50e+03");
+  CHECK_EQ(scalar("-0"), "-0");
+}
+
+void test_literals() {
+  CHECK_EQ(scalar("[true]"), "true");
+  CHECK_EQ(scalar("false"), "false");
+  CHECK_EQ(scalar("[null]"), "null");
+  for (const char* doc : {"[tru]", "[nul]", "[truex]", "[True]"})
+    CHECK(!valid(doc));
+}
+
+void test_strings() {
+  CHECK_EQ(scalar(R"(["a\"b\\c\/d\b\f\n\r\t"])"), "a\"b\\c/d\b\f\n\r\t");
+  CHECK_EQ(scalar(R"(["\u0041\u00e9\u20ac"])"), "A\xc3\xa9\xe2\x82\xac");
+  // A pair is one code point; a lone half stands for U+FFFD
+  CHECK_EQ(scalar(R"(["\ud83c\udf27"])"), "\xf0\x9f\x8c\xa7");
+  CHECK_EQ(scalar(R"(["\ud83cx"])"), "\xef\xbf\xbdx");
+  CHECK_EQ(scalar(R"(["\ud83c\n"])"), "\xef\xbf\xbd\n");
+  CHECK_EQ(scalar(R"(["\ud83c\u0041"])"), "\xef\xbf\xbd" "A");
+  CHECK_EQ(scalar(R"(["\udf27"])"), "\xef\xbf\xbd");
+  CHECK_EQ(scalar(R"(["\ud83c"])"), "\xef\xbf\xbd");
+  // A high half ending one string is not paired with the next string
+  Recorder rec;
+  CHECK(parse(R"(["\ud83c","\udf27"])", rec));
+  CHECK_EQ(rec.events, "[ \n0=S:\xef\xbf\xbd\n1=S:\xef\xbf\xbd\n] \n");
+  for (const char* doc : {R"(["\x"])", R"(["\u12g4"])", "[\"a\nb\"]",
+                          R"(["abc)"})
+    CHECK(!valid(doc));
+}
+
+// Over-long strings are cut at MAX_TOKEN, still terminated
+void test_truncation() {
+  const std::string text(JsonStreamParser::MAX_TOKEN + 50, 'x');
+  Recorder rec;
+  CHECK(parse("[\"" + text + "\",1]", rec));
+  const std::string kept(JsonStreamParser::MAX_TOKEN - 1, 'x');
+  CHECK_EQ(rec.events, "[ \n0=S:" + kept + "\n1=N:1\n] \n");
+}
+
+void test_structure() {
+  for (const char* doc : {"", "[", "[1,]", "{\"a\"}", "{\"a\":}", "{1:2}",
+                          "[1]]", "[1] 2", "{\"a\":1,}", "[1 2]"})
+    CHECK(!valid(doc));
+  CHECK(valid(" \t\r\n[ ] "));
+  CHECK(valid("{}"));
+
+  std::string deep(JsonStreamParser::MAX_NESTING, '[');
+  deep += std::string(JsonStreamParser::MAX_NESTING, ']');
+  CHECK(valid(deep.c_str()));
+  CHECK(!valid(("[" + deep + "]").c_str()));
+
+  // Rejected input stays rejected
+  Recorder rec;
+  JsonStreamParser parser(&rec);
+  CHECK(!parser.feed("[1,,", 4));
+  CHECK(parser.failed());
+  CHECK(!parser.feed("2]", 2));
+  CHECK(!parser.finish());
+}
+
+void test_copy_string() {
+  char dst[6];
+  json_copy_string(dst, sizeof(dst), "abc");
+  CHECK_STR(dst, "abc");
+  json_copy_string(dst, sizeof(dst), "abcdefgh");
+  CHECK_STR(dst, "abcde");
+  // "abcd" + the first byte of "é" would split it
+  json_copy_string(dst, sizeof(dst), "abcd\xc3\xa9");
+  CHECK_STR(dst, "abcd");
+  json_copy_string(dst, sizeof(dst), "ab\xe2\x82\xac\xe2\x82\xac");
+  CHECK_STR(dst, "ab\xe2\x82\xac");
+}
+
+void test_append_quoted() {
+  std::string out;
+  json_append_quoted(out, "a\"b\\c\n\x01\xc3\xa9");
+  CHECK_EQ(out, "\"a\\\"b\\\\c\\n\\u0001\xc3\xa9\"");
+  // What it writes parses back to the same string
+  CHECK_EQ(scalar(("[" + out + "]").c_str()), "a\"b\\c\n\x01\xc3\xa9");
+}
+
+}  // namespace
+
+int main() {
+  test_events();
+  test_chunks();
+  test_matches();
+  test_numbers();
+  test_literals();
+  test_strings();
+  test_truncation();
+  test_structure();
+  test_copy_string();
+  test_append_quoted();
+  return test_result();
+}
@@ -0,0 +1,248 @@
+#include "observation_history.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "test.h"
+
+using namespace esphome::weather_bom;
+
+namespace {
+
+constexpr time_t T0 = 1760000400;  // a slot start at any resolution used
+constexpr uint32_t SLOT = 600;
+
+ObservationData obs(float temp, float rain = NAN) {
+  ObservationData o;
+  o.temp = temp;
+  o.rain_since_9am = rain;
+  return o;
+}
+
+// A history at SLOT resolution; at ~2 KB, kept off the stack
+std::unique_ptr<ObservationHistory> make_history() {
+  auto h = std::make_unique<ObservationHistory>();
+  h->set_resolution(SLOT);
+  return h;
+}
+
+// The aggregates as computed from every slot held
+void check_aggregates(const ObservationHistory& h, int line) {
+  int32_t lo = INT32_MAX, hi = INT32_MIN, sum = 0, n = 0;
+  for (uint16_t i = 0; i < h.size(); i++) {
+    const ObservationSample* s = h.get(i);
+    if (s->temp == ObservationSample::NO_TEMP) continue;
+    lo = std::min<int32_t>(lo, s->temp);
+    hi = std::max<int32_t>(hi, s->temp);
+    sum += s->temp;
+    n++;
+  }
+  if (n == 0) {
+    if (!std::isnan(h.temp_min()) || !std::isnan(h.temp_max()) ||
+        !std::isnan(h.temp_mean()))
+      test_fail(__FILE__, line, "aggregates of no temperatures");
+    return;
+  }
+  if (std::fabs(h.temp_min() - lo / 10.0f) > 1e-4f)
+    test_fail(__FILE__, line, "temp_min");
+  if (std::fabs(h.temp_max() - hi / 10.0f) > 1e-4f)
+    test_fail(__FILE__, line, "temp_max");
+  if (std::fabs(h.temp_mean() - sum / (10.0f * n)) > 1e-3f)
+    test_fail(__FILE__, line, "temp_mean");
+}
+
+void test_empty() {
+  auto h = make_history();
+  CHECK_EQ(h->size(), 0);
+  CHECK(h->get(0) == nullptr);
+  CHECK_EQ(h->latest_time(), 0);
+  CHECK(std::isnan(h->temp_min()));
+  CHECK(std::isnan(h->temp_mean()));
+  CHECK(std::isnan(h->temp_trend()));
+  CHECK(std::isnan(h->rain_rate()));
+  h->add(0, obs(20));  // no clock yet
+  CHECK_EQ(h->size(), 0);
+}
+
+// A slot keeps the last observation seen in it; an earlier slot is ignored
+void test_slots() {
+  auto h = make_history();
+  h->add(T0, obs(10));
+  h->add(T0 + SLOT - 1, obs(11));
+  CHECK_EQ(h->size(), 1);
+  CHECK_EQ(h->get(0)->temp, 110);
+  CHECK_EQ(h->latest_time(), T0);
+  h->add(T0 + SLOT, obs(12));
+  CHECK_EQ(h->size(), 2);
+  h->add(T0 + SLOT / 2, obs(99));
+  CHECK_EQ(h->size(), 2);
+  CHECK_EQ(h->get(0)->temp, 110);
+  CHECK_EQ(h->latest_time(), T0 + SLOT);
+  // Slots nothing was seen in stay empty, and count
+  h->add(T0 + 4 * SLOT, obs(13));
+  CHECK_EQ(h->size(), 5);
+  CHECK(h->get(2)->empty());
+  CHECK(h->get(3)->empty());
+  CHECK_EQ(h->get(4)->temp, 130);
+  check_aggregates(*h, __LINE__);
+  // A gap longer than the history leaves only empty slots behind
+  h->add(T0 + 1000 * SLOT, obs(14));
+  CHECK_EQ(h->size(), ObservationHistory::CAPACITY + 1);
+  CHECK_EQ(h->temp_min(), 14.0f);
+  CHECK_EQ(h->temp_max(), 14.0f);
+}
+
+void test_packing() {
+  auto h = make_history();
+  ObservationData o;
+  o.temp = -3.26f;
+  o.humidity = 104;
+  o.wind_kmh = 400;
+  o.rain_since_9am = -1;
+  h->add(T0, o);
+  const ObservationSample* s = h->get(0);
+  CHECK_EQ(s->temp, -33);
+  CHECK_EQ(s->humidity, 100);
+  CHECK_EQ(s->wind_kmh, 254);
+  CHECK_EQ(s->rain, 0);
+  h->add(T0 + SLOT, ObservationData{});
+  CHECK(h->get(1)->empty());
+  CHECK_EQ(h->get(1)->humidity, ObservationSample::NO_VALUE);
+}
+
+// The monotonic queues against a scan of the slots, as samples enter and
+// leave the ring, with gaps and slots without a temperature mixed in
+void test_min_max_mean() {
+  auto h = make_history();
+  uint32_t x = 1;
+  time_t when = T0;
+  for (int i = 0; i < 5 * ObservationHistory::CAPACITY; i++) {
+    x = x * 1103515245 + 12345;
+    const uint32_t r = x >> 16;
+    when += (r % 10 == 0 ? 3 : 1) * SLOT;
+    const float temp = r % 7 == 0 ? NAN : (int)(r % 500) / 10.0f - 10;
+    h->add(when, obs(temp));
+    check_aggregates(*h, __LINE__);
+  }
+  // Falling, then rising: each end of the queues gets used
+  for (int i = 0; i < 2 * ObservationHistory::CAPACITY; i++) {
+    when += SLOT;
+    h->add(when, obs(i < ObservationHistory::CAPACITY ? 50 - i * 0.1f
+                                                      : 30 + i * 0.1f));
+    check_aggregates(*h, __LINE__);
+  }
+}
+
+// 0.1 °C a slot is 1.8 °C over 3 h; a missing sample 3 h back is taken
+// from a neighbouring slot
+void test_trend() {
+  auto h = make_history();
+  for (int i = 0; i < 30; i++) h->add(T0 + i * SLOT, obs(20 + i * 0.1f));
+  CHECK_NEAR(h->temp_trend(), 1.8f, 1e-3f);
+
+  h = make_history();
+  for (int i = 0; i < 30; i++)
+    h->add(T0 + i * SLOT, obs(i == 29 - 18 ? NAN : 20 - i * 0.2f));
+  CHECK_NEAR(h->temp_trend(), -3.6f, 1e-3f);
+
+  h = make_history();
+  for (int i = 0; i < 10; i++) h->add(T0 + i * SLOT, obs(20));
+  CHECK(std::isnan(h->temp_trend()));  // under 3 h held
+}
+
+// Rain since 9 am rising 0.2 mm a slot is 1.2 mm/h; across the 9 am reset
+// only the rain since the reset counts
+void test_rain_rate() {
+  auto h = make_history();
+  for (int i = 0; i < 10; i++) h->add(T0 + i * SLOT, obs(20, i * 0.2f));
+  CHECK_NEAR(h->rain_rate(), 1.2f, 1e-3f);
+  h->add(T0 + 10 * SLOT, obs(20, 0.4f));
+  CHECK_NEAR(h->rain_rate(), 0.4f, 1e-3f);
+  h->add(T0 + 11 * SLOT, obs(20));
+  CHECK(std::isnan(h->rain_rate()));
+}
+
+bool same_samples(const ObservationHistory& a, const ObservationHistory& b) {
+  if (a.size() != b.size() || a.latest_time() != b.latest_time())
+    return false;
+  for (uint16_t i = 0; i < a.size(); i++) {
+    if (memcmp(a.get(i), b.get(i), sizeof(ObservationSample)) != 0)
+      return false;
+  }
+  return true;
+}
+
+void test_dump_load() {
+  auto h = make_history();
+  for (int i = 0; i < ObservationHistory::CAPACITY + 20; i++)
+    h->add(T0 + i * SLOT, obs(i % 37 - 5.5f, i % 5 * 0.2f));
+  uint8_t buf[ObservationHistory::DUMP_MAX];
+  const size_t len = h->dump(buf, sizeof(buf));
+  CHECK_EQ(len, ObservationHistory::DUMP_MAX);
+  CHECK_EQ(h->dump(buf, len - 1), 0u);
+
+  auto copy = make_history();
+  CHECK(copy->load(buf, len));
+  CHECK(same_samples(*h, *copy));
+  CHECK_EQ(copy->temp_min(), h->temp_min());
+  CHECK_EQ(copy->temp_max(), h->temp_max());
+  CHECK_NEAR(copy->temp_mean(), h->temp_mean(), 1e-4f);
+  CHECK_NEAR(copy->temp_trend(), h->temp_trend(), 1e-4f);
+  // And it carries on from there like the original
+  h->add(T0 + 200 * SLOT, obs(40));
+  copy->add(T0 + 200 * SLOT, obs(40));
+  CHECK(same_samples(*h, *copy));
+  check_aggregates(*copy, __LINE__);
+
+  // Only the newest slots
+  const size_t part = h->dump(buf, sizeof(buf), 72);
+  CHECK_EQ(part, ObservationHistory::DUMP_HEADER +
+                     72 * sizeof(ObservationSample));
+  CHECK(copy->load(buf, part));
+  CHECK_EQ(copy->size(), 72);
+  CHECK_EQ(copy->latest_time(), h->latest_time());
+  CHECK_EQ(memcmp(copy->get(0), h->get(h->size() - 72),
+                  sizeof(ObservationSample)),
+           0);
+  check_aggregates(*copy, __LINE__);
+
+  // An empty history round-trips too
+  auto empty = make_history();
+  CHECK(copy->load(buf, empty->dump(buf, sizeof(buf))));
+  CHECK_EQ(copy->size(), 0);
+}
+
+// A dump that does not fit leaves the history as it was
+void test_load_rejects() {
+  auto h = make_history();
+  for (int i = 0; i < 10; i++) h->add(T0 + i * SLOT, obs(i));
+  uint8_t buf[ObservationHistory::DUMP_MAX];
+  const size_t len = h->dump(buf, sizeof(buf));
+  auto other = make_history();
+  other->add(T0, obs(1));
+
+  CHECK(!other->load(buf, len - 1));
+  CHECK(!other->load(buf, 4));
+  auto hourly = std::make_unique<ObservationHistory>();
+  hourly->set_resolution(3600);
+  CHECK(!hourly->load(buf, len));
+  buf[0] ^= 1;
+  CHECK(!other->load(buf, len));
+  CHECK_EQ(other->size(), 1);
+  CHECK_EQ(other->get(0)->temp, 10);
+}
+
+}  // namespace
+
+int main() {
+  test_empty();
+  test_slots();
+  test_packing();
+  test_min_max_mean();
+  test_trend();
+  test_rain_rate();
+  test_dump_load();
+  test_load_rejects();
+  return test_result();
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// Just enough for the host tests: a failed check is printed and counted and
+// the test goes on; main() returns test_result().
+
+inline int &test_failures() {
+  static int failures = 0;
+  return failures;
+}
+
+inline void test_fail(const char *file, int line, const char *what) {
+  printf("%s:%d: check failed: %s\n", file, line, what);
+  test_failures()++;
+}
+
+inline int test_result() {
+  if (test_failures() != 0) printf("%d check(s) failed\n", test_failures());
+  return test_failures() == 0 ? 0 : 1;
+}
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) test_fail(__FILE__, __LINE__, #cond); \
+  } while (0)
+
+#define CHECK_EQ(a, b) CHECK((a) == (b))
+#define CHECK_STR(a, b) CHECK(strcmp((a), (b)) == 0)
+#define CHECK_NEAR(a, b, eps) CHECK(std::fabs((a) - (b)) <= (eps))
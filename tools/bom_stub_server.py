@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+"""Local stand-in for api.weather.bom.gov.au.
+
+Replays recorded BOM responses from a fixtures directory so the host build of
+the weather_bom component can run its full fetch -> parse -> publish cycle
+without a device or the real API. Latency and chunking are configurable to
+mimic a slow link.
+
+    python3 tools/bom_stub_server.py --port 8080 --latency-ms 150 \\
+        --chunk-size 512 --chunk-delay-ms 20
+
+Then point the component at it with `api_base_url: http://127.0.0.1:8080/v1`.
+
+Responses carry an ETag and Last-Modified derived from the fixture file and
+conditional requests are answered with 304 (disable with --no-validators);
+edit a fixture to simulate a new BOM issue. With --gzip, requests carrying
+Accept-Encoding: gzip get a gzip-compressed body (and their own ETag).
+
+Fixture files (any may be replaced by real recordings):
+    search.json          /v1/locations?search=<lat>,<lon>
+    observations.json    /v1/locations/<geohash>/observations
+    forecast_daily.json  /v1/locations/<geohash>/forecasts/daily
+    forecast_hourly.json /v1/locations/<geohash>/forecasts/hourly
+    warnings.json        /v1/locations/<geohash>/warnings
+"""
+
+import argparse
+import email.utils
+import gzip
+import hashlib
+import os
+import re
+import sys
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import urlsplit
+
+ROUTES = [
+    (re.compile(r"^/v1/locations$"), "search.json"),
+    (re.compile(r"^/v1/locations/[0-9a-z]+/observations$"), "observations.json"),
+    (re.compile(r"^/v1/locations/[0-9a-z]+/forecasts/daily$"), "forecast_daily.json"),
+    (re.compile(r"^/v1/locations/[0-9a-z]+/forecasts/hourly$"), "forecast_hourly.json"),
+    (re.compile(r"^/v1/locations/[0-9a-z]+/warnings$"), "warnings.json"),
+]
+
+
+class BomStubHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # keep-alive, like the real API
+    server_version = "bom-stub/1.0"
+
+    def do_GET(self):
+        start = time.monotonic()
+        opts = self.server.opts
+        path = urlsplit(self.path).path
+
+        fixture = next((f for rx, f in ROUTES if rx.match(path)), None)
+        if fixture is None:
+            self._send_simple(404, b'{"errors":[{"code":"NOT_FOUND"}]}')
+            return
+
+        fixture_path = os.path.join(opts.fixtures, fixture)
+        try:
+            with open(fixture_path, "rb") as f:
+                body = f.read()
+            mtime = int(os.path.getmtime(fixture_path))
+        except OSError:
+            self._send_simple(500, b'{"errors":[{"code":"NO_FIXTURE"}]}')
+            return
+
+        if opts.latency_ms:
+            time.sleep(opts.latency_ms / 1000.0)
+
+        etag = '"%s"' % hashlib.sha1(body).hexdigest()[:16]
+        encoding = None
+        accepted = [
+            a.split(";")[0].strip()
+            for a in self.headers.get("Accept-Encoding", "").split(",")
+        ]
+        if opts.gzip and "gzip" in accepted:
+            encoding = "gzip"
+            etag = etag[:-1] + '-gz"'
+            body = gzip.compress(body, mtime=mtime)
+        last_modified = email.utils.formatdate(mtime, usegmt=True)
+        if opts.validators and self._not_modified(etag, mtime):
+            self.send_response(304)
+            self.send_header("ETag", etag)
+            self.send_header("Last-Modified", last_modified)
+            self.end_headers()
+            self.log_message('"%s" 304', self.requestline)
+            return
+
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        if opts.gzip:
+            self.send_header("Vary", "Accept-Encoding")
+        if encoding:
+            self.send_header("Content-Encoding", encoding)
+        if opts.validators:
+            self.send_header("ETag", etag)
+            self.send_header("Last-Modified", last_modified)
+        if opts.chunked:
+            self.send_header("Transfer-Encoding", "chunked")
+        else:
+            self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+
+        size = opts.chunk_size or len(body)
+        for off in range(0, len(body), size):
+            piece = body[off : off + size]
+            if opts.chunked:
+                self.wfile.write(b"%x\r\n%s\r\n" % (len(piece), piece))
+            else:
+                self.wfile.write(piece)
+            self.wfile.flush()
+            if opts.chunk_delay_ms and off + size < len(body):
+                time.sleep(opts.chunk_delay_ms / 1000.0)
+        if opts.chunked:
+            self.wfile.write(b"0\r\n\r\n")
+
+        self.log_message(
+            '"%s" 200 %d bytes in %.1f ms',
+            self.requestline,
+            len(body),
+            (time.monotonic() - start) * 1000.0,
+        )
+
+    def _not_modified(self, etag, mtime):
+        inm = self.headers.get("If-None-Match")
+        if inm is not None:
+            return etag in [t.strip() for t in inm.split(",")]
+        ims = self.headers.get("If-Modified-Since")
+        if ims is not None:
+            try:
+                return mtime <= email.utils.parsedate_to_datetime(ims).timestamp()
+            except (TypeError, ValueError):
+                return False
+        return False
+
+    def _send_simple(self, status, body):
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_request(self, code="-", size="-"):
+        # do_GET logs its own line with timing; keep error paths visible
+        if code not in (200, 304):
+            super().log_request(code, size)
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    p = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    p.add_argument("--host", default="127.0.0.1")
+    p.add_argument("--port", type=int, default=8080)
+    p.add_argument("--fixtures", default=os.path.join(here, "fixtures"))
+    p.add_argument("--latency-ms", type=int, default=0,
+                   help="delay before the response starts")
+    p.add_argument("--chunk-size", type=int, default=0,
+                   help="write the body in pieces of this many bytes")
+    p.add_argument("--chunk-delay-ms", type=int, default=0,
+                   help="delay between body pieces")
+    p.add_argument("--chunked", action="store_true",
+                   help="use Transfer-Encoding: chunked instead of Content-Length")
+    p.add_argument("--gzip", action="store_true",
+                   help="gzip the body for clients that accept it")
+    p.add_argument("--no-validators", dest="validators", action="store_false",
+                   help="omit ETag/Last-Modified and never answer 304")
+    opts = p.parse_args()
+
+    server = ThreadingHTTPServer((opts.host, opts.port), BomStubHandler)
+    server.opts = opts
+    print(f"Serving BOM fixtures from {opts.fixtures} on "
+          f"http://{opts.host}:{opts.port}/v1", file=sys.stderr)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()